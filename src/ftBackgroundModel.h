@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ftBackgroundModelShader.h"
+
+namespace flowTools {
+
+	// Background subtraction for sources without a body index. A running average and variance of every
+	// pixel's luminance is kept at flow resolution and updated with each new frame. Pixels far enough off
+	// the background, measured in standard deviations, are foreground. Foreground pixels only learn at the
+	// much slower absorb rate, so a still audience stays foreground while a moved chair fades in over time. The mask is applied to the source at
+	// full resolution, like the users-only depth does for the Kinect, so only people reach recolor, the
+	// optical flow and the velocity mask. Everything runs on the gpu in three small passes.
+	class ftBackgroundModel {
+	public:
+		ftBackgroundModel() : width(0), height(0), current(0), initialized(false) {
+			parameters.setName("background");
+			parameters.add(enabled.set("Subtract background", false));
+			parameters.add(learningRate.set("Learning rate", 0.01, 0.0005, 0.2));
+			parameters.add(absorbRate.set("Absorb rate", 0.0002, 0, 0.01));
+			parameters.add(threshold.set("Threshold (sigma)", 3, 0.5, 10));
+			parameters.add(softness.set("Softness (sigma)", 1, 0, 4));
+			parameters.add(minDeviation.set("Min deviation", 0.02, 0.001, 0.2));
+		}
+
+		// model and mask size, _outputWidth x _outputHeight for the masked source
+		void setup(int _width, int _height, int _outputWidth, int _outputHeight) {
+			width = _width;
+			height = _height;
+			for (int i = 0; i < 2; i++) {
+				modelFbos[i].allocate(width, height, GL_RG32F);
+				modelFbos[i].black();
+			}
+			maskFbo.allocate(width, height, GL_R8);
+			maskFbo.black();
+			maskedFbo.allocate(_outputWidth, _outputHeight, GL_RGB);
+			maskedFbo.black();
+			reset();
+		}
+
+		// the next frame starts a new model, e.g. after the source changed
+		void reset() { initialized = false; }
+
+		// Updates the mask from the model so far, then learns the frame where it is background
+		void learn(ofTexture& source) {
+			int previous = current;
+			current = 1 - current;
+			if (initialized) {
+				maskShader.update(maskFbo, modelFbos[previous].getTexture(), source, threshold, softness, minDeviation);
+			}
+			else {
+				maskFbo.black();
+			}
+			updateShader.update(modelFbos[current], modelFbos[previous].getTexture(), source, maskFbo.getTexture(), learningRate, absorbRate, !initialized);
+			initialized = true;
+		}
+
+		// The frame last learned with the background blacked out
+		ofTexture& apply(ofTexture& source) {
+			applyMaskShader.update(maskedFbo, source, maskFbo.getTexture());
+			return maskedFbo.getTexture();
+		}
+
+		ofTexture& update(ofTexture& source) {
+			learn(source);
+			return apply(source);
+		}
+
+		ofTexture& getMask() { return maskFbo.getTexture(); }
+		ofTexture& getBackground() { return modelFbos[current].getTexture(); }
+		bool isEnabled() { return enabled.get(); }
+
+		ofParameterGroup	parameters;
+		ofParameter<bool>	enabled;
+		ofParameter<float>	learningRate; // per frame, of the background
+		ofParameter<float>	absorbRate; // per frame, about 1 / frames until a still foreground object is background
+		ofParameter<float>	threshold;
+		ofParameter<float>	softness;
+		ofParameter<float>	minDeviation; // in luminance, keeps noise out of very still areas
+
+	protected:
+		int		width;
+		int		height;
+		int		current;
+		bool	initialized;
+
+		ftFbo	modelFbos[2];
+		ftFbo	maskFbo;
+		ftFbo	maskedFbo;
+
+		ftBackgroundUpdateShader	updateShader;
+		ftForegroundMaskShader		maskShader;
+		ftApplyMaskShader			applyMaskShader;
+	};
+}
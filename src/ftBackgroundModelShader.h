@@ -0,0 +1,252 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Running average and variance of the source luminance per pixel: r = mean, g = variance.
+	// Foreground in the mask learns at absorbRate instead, so people standing still stay foreground.
+	// With initialize set the model restarts from the source
+	class ftBackgroundUpdateShader : public ftShader {
+	public:
+		ftBackgroundUpdateShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect modelTex;
+				uniform sampler2DRect sourceTex;
+				uniform vec2 sourceScale;
+				uniform sampler2DRect maskTex;
+				uniform float learningRate;
+				uniform float absorbRate;
+				uniform float initialize;
+
+				void main() {
+					vec2 pos = gl_TexCoord[0].st;
+					float luminance = dot(texture2DRect(sourceTex, pos * sourceScale).rgb, vec3(0.299, 0.587, 0.114));
+					vec2 model = texture2DRect(modelTex, pos).rg;
+					float rate = mix(learningRate, absorbRate, texture2DRect(maskTex, pos).r);
+					float difference = luminance - model.r;
+					float mean = model.r + difference * rate;
+					float variance = mix(model.g, difference * difference, rate);
+					gl_FragColor = (initialize > 0.5) ? vec4(luminance, 0.0, 0.0, 1.0) : vec4(mean, variance, 0.0, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect modelTex;
+				uniform sampler2DRect sourceTex;
+				uniform vec2 sourceScale;
+				uniform sampler2DRect maskTex;
+				uniform float learningRate;
+				uniform float absorbRate;
+				uniform float initialize;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				void main() {
+					vec2 pos = texCoordVarying;
+					float luminance = dot(texture(sourceTex, pos * sourceScale).rgb, vec3(0.299, 0.587, 0.114));
+					vec2 model = texture(modelTex, pos).rg;
+					float rate = mix(learningRate, absorbRate, texture(maskTex, pos).r);
+					float difference = luminance - model.r;
+					float mean = model.r + difference * rate;
+					float variance = mix(model.g, difference * difference, rate);
+					fragColor = (initialize > 0.5) ? vec4(luminance, 0.0, 0.0, 1.0) : vec4(mean, variance, 0.0, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		// _maskTex is the foreground of this frame at the size of the model
+		void update(ofFbo& dest, ofTexture& _modelTex, ofTexture& _sourceTex, ofTexture& _maskTex, float _learningRate, float _absorbRate, bool _initialize) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("modelTex", _modelTex, 0);
+			shader.setUniformTexture("sourceTex", _sourceTex, 1);
+			shader.setUniform2f("sourceScale", _sourceTex.getWidth() / dest.getWidth(), _sourceTex.getHeight() / dest.getHeight());
+			shader.setUniformTexture("maskTex", _maskTex, 2);
+			shader.setUniform1f("learningRate", _learningRate);
+			shader.setUniform1f("absorbRate", _absorbRate);
+			shader.setUniform1f("initialize", _initialize ? 1.0 : 0.0);
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+
+	// Foreground probability per pixel: how many standard deviations the source is off the background mean,
+	// ramped from threshold - softness to threshold + softness
+	class ftForegroundMaskShader : public ftShader {
+	public:
+		ftForegroundMaskShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect modelTex;
+				uniform sampler2DRect sourceTex;
+				uniform vec2 sourceScale;
+				uniform float threshold;
+				uniform float softness;
+				uniform float minDeviation;
+
+				void main() {
+					vec2 pos = gl_TexCoord[0].st;
+					float luminance = dot(texture2DRect(sourceTex, pos * sourceScale).rgb, vec3(0.299, 0.587, 0.114));
+					vec2 model = texture2DRect(modelTex, pos).rg;
+					float deviation = max(sqrt(model.g), minDeviation);
+					float distance = abs(luminance - model.r) / deviation;
+					gl_FragColor = vec4(vec3(smoothstep(threshold - softness, threshold + softness, distance)), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect modelTex;
+				uniform sampler2DRect sourceTex;
+				uniform vec2 sourceScale;
+				uniform float threshold;
+				uniform float softness;
+				uniform float minDeviation;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				void main() {
+					vec2 pos = texCoordVarying;
+					float luminance = dot(texture(sourceTex, pos * sourceScale).rgb, vec3(0.299, 0.587, 0.114));
+					vec2 model = texture(modelTex, pos).rg;
+					// a noise floor, so a perfectly still background doesn't turn every flicker into a person
+					float deviation = max(sqrt(model.g), minDeviation);
+					float distance = abs(luminance - model.r) / deviation;
+					fragColor = vec4(vec3(smoothstep(threshold - softness, threshold + softness, distance)), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		void update(ofFbo& dest, ofTexture& _modelTex, ofTexture& _sourceTex, float _threshold, float _softness, float _minDeviation) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("modelTex", _modelTex, 0);
+			shader.setUniformTexture("sourceTex", _sourceTex, 1);
+			shader.setUniform2f("sourceScale", _sourceTex.getWidth() / dest.getWidth(), _sourceTex.getHeight() / dest.getHeight());
+			shader.setUniform1f("threshold", _threshold);
+			shader.setUniform1f("softness", _softness);
+			shader.setUniform1f("minDeviation", _minDeviation);
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+
+	// The source multiplied by a mask of any resolution, the mask is sampled linearly so its edges stay soft
+	class ftApplyMaskShader : public ftShader {
+	public:
+		ftApplyMaskShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect sourceTex;
+				uniform sampler2DRect maskTex;
+				uniform vec2 sourceScale;
+				uniform vec2 maskScale;
+
+				void main() {
+					vec2 pos = gl_TexCoord[0].st;
+					vec3 color = texture2DRect(sourceTex, pos * sourceScale).rgb;
+					gl_FragColor = vec4(color * texture2DRect(maskTex, pos * maskScale).r, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect sourceTex;
+				uniform sampler2DRect maskTex;
+				uniform vec2 sourceScale;
+				uniform vec2 maskScale;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				void main() {
+					vec2 pos = texCoordVarying;
+					vec3 color = texture(sourceTex, pos * sourceScale).rgb;
+					fragColor = vec4(color * texture(maskTex, pos * maskScale).r, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		void update(ofFbo& dest, ofTexture& _sourceTex, ofTexture& _maskTex) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("sourceTex", _sourceTex, 0);
+			shader.setUniformTexture("maskTex", _maskTex, 1);
+			shader.setUniform2f("sourceScale", _sourceTex.getWidth() / dest.getWidth(), _sourceTex.getHeight() / dest.getHeight());
+			shader.setUniform2f("maskScale", _maskTex.getWidth() / dest.getWidth(), _maskTex.getHeight() / dest.getHeight());
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Reconstructs RGB from the 8 bit raw Bayer frames of the PS3Eye (see PS3EYECam::OUTPUT_BAYER).
+	// The raw frame is uploaded as a single channel texture and demosaiced here with bilinear interpolation,
+	// so the USB bus and the CPU only ever see 1 byte per pixel.
+	class ftDebayerShader : public ftShader {
+	public:
+		ftDebayerShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect bayerTexture;
+				uniform vec2 firstRed;
+
+				float fetch(vec2 p) {
+					return texture2DRect(bayerTexture, p).r;
+				}
+
+				void main() {
+					vec2 p = floor(gl_TexCoord[0].st) + vec2(0.5);
+					vec2 parity = mod(floor(gl_TexCoord[0].st) + firstRed, vec2(2.0));
+
+					float center = fetch(p);
+					float horizontal = (fetch(p + vec2(-1.0, 0.0)) + fetch(p + vec2(1.0, 0.0))) * 0.5;
+					float vertical = (fetch(p + vec2(0.0, -1.0)) + fetch(p + vec2(0.0, 1.0))) * 0.5;
+					float diagonal = (fetch(p + vec2(-1.0, -1.0)) + fetch(p + vec2(1.0, -1.0)) +
+									  fetch(p + vec2(-1.0, 1.0)) + fetch(p + vec2(1.0, 1.0))) * 0.25;
+					float adjacent = (horizontal + vertical) * 0.5;
+
+					vec3 rgb;
+					if (parity.x < 0.5 && parity.y < 0.5)
+						rgb = vec3(center, adjacent, diagonal);	// red site
+					else if (parity.x > 0.5 && parity.y > 0.5)
+						rgb = vec3(diagonal, adjacent, center);	// blue site
+					else if (parity.y < 0.5)
+						rgb = vec3(horizontal, center, vertical);	// green on a red row
+					else
+						rgb = vec3(vertical, center, horizontal);	// green on a blue row
+
+					gl_FragColor = vec4(rgb, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect bayerTexture;
+				uniform vec2 firstRed;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				float fetch(vec2 p) {
+					return texture(bayerTexture, p).r;
+				}
+
+				void main() {
+					vec2 p = floor(texCoordVarying) + vec2(0.5);
+					vec2 parity = mod(floor(texCoordVarying) + firstRed, vec2(2.0));
+
+					float center = fetch(p);
+					float horizontal = (fetch(p + vec2(-1.0, 0.0)) + fetch(p + vec2(1.0, 0.0))) * 0.5;
+					float vertical = (fetch(p + vec2(0.0, -1.0)) + fetch(p + vec2(0.0, 1.0))) * 0.5;
+					float diagonal = (fetch(p + vec2(-1.0, -1.0)) + fetch(p + vec2(1.0, -1.0)) +
+									  fetch(p + vec2(-1.0, 1.0)) + fetch(p + vec2(1.0, 1.0))) * 0.25;
+					float adjacent = (horizontal + vertical) * 0.5;
+
+					vec3 rgb;
+					if (parity.x < 0.5 && parity.y < 0.5)
+						rgb = vec3(center, adjacent, diagonal);	// red site
+					else if (parity.x > 0.5 && parity.y > 0.5)
+						rgb = vec3(diagonal, adjacent, center);	// blue site
+					else if (parity.y < 0.5)
+						rgb = vec3(horizontal, center, vertical);	// green on a red row
+					else
+						rgb = vec3(vertical, center, horizontal);	// green on a blue row
+
+					fragColor = vec4(rgb, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		// _firstRed is the position of the first red sample in the 2x2 Bayer tile, (1, 1) for the BGGR OV772x
+		void update(ofFbo& dest, ofTexture& _bayerTexture, ofVec2f _firstRed = ofVec2f(1, 1)) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("bayerTexture", _bayerTexture, 0);
+			// firstRed is used as an offset that moves the red site to an even/even position
+			shader.setUniform2f("firstRed", _firstRed.x, _firstRed.y);
+			renderFrame(dest.getWidth(), dest.getHeight(), _bayerTexture.getWidth(), _bayerTexture.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
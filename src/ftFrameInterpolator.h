@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ftWarpShader.h"
+
+namespace flowTools {
+
+	// Fills the render ticks between camera frames. The optical flow of the last camera frame is kept and
+	// the frame is warped along it to the time of every tick in between, a fraction of the usual frame
+	// interval ahead (a short extrapolation, so no extra latency). The passes after it see a frame moving
+	// at display rate, the camera keeps its own rate.
+	class ftFrameInterpolator {
+	public:
+		ftFrameInterpolator() : frameTime(0), frameInterval(0), hasFlow(false) {
+			parameters.setName("frame interpolation");
+			parameters.add(enabled.set("Interpolate frames", false));
+			parameters.add(warpScale.set("Warp scale", 1, 0, 4));
+			parameters.add(maxAhead.set("Max ahead (frames)", 1, 0, 2));
+		}
+
+		void setup(int _flowWidth, int _flowHeight) {
+			flowFbo.allocate(_flowWidth, _flowHeight, GL_RG32F);
+			flowFbo.black();
+			accumulatedFbo.allocate(_flowWidth, _flowHeight, GL_RG32F);
+			accumulatedFbo.black();
+			hasFlow = false;
+		}
+
+		void reset() {
+			hasFlow = false;
+			frameInterval = 0;
+			accumulatedFbo.black();
+		}
+
+		// After the optical flow of a new camera frame, at _time on the app clock. The flow since the last
+		// camera frame is what was measured on the ticks in between plus the rest measured now
+		void addFrame(ofTexture& flow, float _time) {
+			if (frameTime > 0 && _time > frameTime) {
+				float interval = _time - frameTime;
+				// smoothed, a late frame shouldn't stretch the next ones
+				frameInterval = frameInterval > 0 ? frameInterval * 0.9f + interval * 0.1f : interval;
+			}
+			frameTime = _time;
+			ofPushStyle();
+			flowFbo.begin();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			flow.draw(0, 0, flowFbo.getWidth(), flowFbo.getHeight());
+			ofEnableBlendMode(OF_BLENDMODE_ADD);
+			accumulatedFbo.draw(0, 0);
+			flowFbo.end();
+			ofPopStyle();
+			accumulatedFbo.black();
+			hasFlow = true;
+		}
+
+		// Drops the flow measured on the ticks since the last camera frame, before addFrame() with a flow that
+		// already covers the whole interval (e.g. one from a cache)
+		void clearTicks() {
+			accumulatedFbo.black();
+		}
+
+		// After the optical flow of an interpolated tick
+		void addTick(ofTexture& flow) {
+			ofPushStyle();
+			accumulatedFbo.begin();
+			ofEnableBlendMode(OF_BLENDMODE_ADD);
+			flow.draw(0, 0, accumulatedFbo.getWidth(), accumulatedFbo.getHeight());
+			accumulatedFbo.end();
+			ofPopStyle();
+		}
+
+		bool isReady() { return enabled.get() && hasFlow && frameInterval > 0; }
+
+		// Warps the last camera frame (or anything aligned with it) on to _time into dest
+		ofTexture& update(ofFbo& dest, ofTexture& frame, float _time) {
+			float ahead = ofClamp((_time - frameTime) / frameInterval, 0, maxAhead);
+			// the flow is in fractions of the frame per camera frame
+			ofVec2f displacement(dest.getWidth() * warpScale * ahead, dest.getHeight() * warpScale * ahead);
+			warpShader.update(dest, frame, flowFbo.getTexture(), displacement);
+			return dest.getTexture();
+		}
+
+		ofParameterGroup	parameters;
+		ofParameter<bool>	enabled;
+		ofParameter<float>	warpScale; // flow units to fractions of the frame, calibrates the warp to the flow
+		ofParameter<float>	maxAhead;
+
+	protected:
+		float	frameTime;
+		float	frameInterval;
+		bool	hasFlow;
+
+		ftFbo	flowFbo; // from the last camera frame to the one before
+		ftFbo	accumulatedFbo; // measured on the ticks since the last camera frame
+
+		ftWarpShader warpShader;
+	};
+}
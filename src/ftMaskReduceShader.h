@@ -0,0 +1,88 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Shrinks a foreground mask to a few cells: every destination pixel is the foreground fraction of its
+	// block of the mask, from 4x4 taps. The mask is either a 0..1 foreground mask or a Kinect body index,
+	// where everything but 255 is a person.
+	class ftMaskReduceShader : public ftShader {
+	public:
+		ftMaskReduceShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect maskTex;
+				uniform vec2 blockSize;
+				uniform float isBodyIndex;
+
+				void main() {
+					vec2 origin = floor(gl_TexCoord[0].st) * blockSize;
+					float sum = 0.0;
+					for (int y = 0; y < 4; y++) {
+						for (int x = 0; x < 4; x++) {
+							float value = texture2DRect(maskTex, origin + (vec2(x, y) + 0.5) * blockSize * 0.25).r;
+							sum += (isBodyIndex > 0.5) ? step(value, 0.99) : value;
+						}
+					}
+					gl_FragColor = vec4(vec3(sum / 16.0), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect maskTex;
+				uniform vec2 blockSize;
+				uniform float isBodyIndex;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				void main() {
+					vec2 origin = floor(texCoordVarying) * blockSize;
+					float sum = 0.0;
+					for (int y = 0; y < 4; y++) {
+						for (int x = 0; x < 4; x++) {
+							float value = texture(maskTex, origin + (vec2(x, y) + 0.5) * blockSize * 0.25).r;
+							// body index 255 is background
+							sum += (isBodyIndex > 0.5) ? step(value, 0.99) : value;
+						}
+					}
+					fragColor = vec4(vec3(sum / 16.0), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		void update(ofFbo& dest, ofTexture& _maskTex, bool _isBodyIndex) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("maskTex", _maskTex, 0);
+			shader.setUniform2f("blockSize", _maskTex.getWidth() / dest.getWidth(), _maskTex.getHeight() / dest.getHeight());
+			shader.setUniform1f("isBodyIndex", _isBodyIndex ? 1.0 : 0.0);
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Merges a depth frame and a camera frame into one texture in a single pass. The depth fills the
+	// destination, the camera is placed by a rect in destination pixels (the registration between the two).
+	// Depth is scaled to 0..1 and shown as gray, both are weighted and summed.
+	class ftMergeShader : public ftShader {
+	public:
+		ftMergeShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect depthTex;
+				uniform sampler2DRect cameraTex;
+				uniform vec2 depthScale; // dest to depth pixels
+				uniform vec4 cameraRect;
+				uniform vec2 cameraSize;
+				uniform float depthRange;
+				uniform float depthWeight;
+				uniform float cameraWeight;
+
+				void main() {
+					vec2 pos = gl_TexCoord[0].st;
+					float depth = clamp(texture2DRect(depthTex, pos * depthScale).r * depthRange, 0.0, 1.0);
+					vec3 color = vec3(depth * depthWeight);
+					vec2 local = (pos - cameraRect.xy) / cameraRect.zw;
+					if (all(greaterThanEqual(local, vec2(0.0))) && all(lessThanEqual(local, vec2(1.0))))
+						color += texture2DRect(cameraTex, local * cameraSize).rgb * cameraWeight;
+					gl_FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect depthTex;
+				uniform sampler2DRect cameraTex;
+				uniform vec2 depthScale; // dest to depth pixels
+				uniform vec4 cameraRect;
+				uniform vec2 cameraSize;
+				uniform float depthRange;
+				uniform float depthWeight;
+				uniform float cameraWeight;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				void main() {
+					vec2 pos = texCoordVarying;
+					float depth = clamp(texture(depthTex, pos * depthScale).r * depthRange, 0.0, 1.0);
+					vec3 color = vec3(depth * depthWeight);
+					// outside its rect the camera adds nothing
+					vec2 local = (pos - cameraRect.xy) / cameraRect.zw;
+					if (all(greaterThanEqual(local, vec2(0.0))) && all(lessThanEqual(local, vec2(1.0))))
+						color += texture(cameraTex, local * cameraSize).rgb * cameraWeight;
+					fragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		// _depthRange scales the raw depth texture to 0..1, _cameraRect is (x, y, width, height) in dest pixels
+		void update(ofFbo& dest, ofTexture& _depthTex, ofTexture& _cameraTex, ofRectangle _cameraRect, float _depthRange, float _depthWeight, float _cameraWeight) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("depthTex", _depthTex, 0);
+			shader.setUniformTexture("cameraTex", _cameraTex, 1);
+			shader.setUniform2f("depthScale", _depthTex.getWidth() / dest.getWidth(), _depthTex.getHeight() / dest.getHeight());
+			shader.setUniform4f("cameraRect", _cameraRect.x, _cameraRect.y, _cameraRect.width, _cameraRect.height);
+			shader.setUniform2f("cameraSize", _cameraTex.getWidth(), _cameraTex.getHeight());
+			shader.setUniform1f("depthRange", _depthRange);
+			shader.setUniform1f("depthWeight", _depthWeight);
+			shader.setUniform1f("cameraWeight", _cameraWeight);
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// The animated noise LUT of ofxRecolor: one row of colors, each channel 3d simplex noise along the row
+	// and over time, like the ofNoise() calls it replaces. The simplex noise is Ian McEwan's (Ashima Arts, MIT).
+	class ftNoiseLutShader : public ftShader {
+	public:
+		ftNoiseLutShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform float time;
+				uniform float noiseScale;
+				uniform float size;
+
+				vec3 mod289(vec3 x) { return x - floor(x * (1.0 / 289.0)) * 289.0; }
+				vec4 mod289(vec4 x) { return x - floor(x * (1.0 / 289.0)) * 289.0; }
+				vec4 permute(vec4 x) { return mod289(((x * 34.0) + 1.0) * x); }
+				vec4 taylorInvSqrt(vec4 r) { return 1.79284291400159 - 0.85373472095314 * r; }
+
+				float snoise(vec3 v) {
+					const vec2 C = vec2(1.0 / 6.0, 1.0 / 3.0);
+					const vec4 D = vec4(0.0, 0.5, 1.0, 2.0);
+
+					vec3 i = floor(v + dot(v, C.yyy));
+					vec3 x0 = v - i + dot(i, C.xxx);
+					vec3 g = step(x0.yzx, x0.xyz);
+					vec3 l = 1.0 - g;
+					vec3 i1 = min(g.xyz, l.zxy);
+					vec3 i2 = max(g.xyz, l.zxy);
+					vec3 x1 = x0 - i1 + C.xxx;
+					vec3 x2 = x0 - i2 + C.yyy;
+					vec3 x3 = x0 - D.yyy;
+
+					i = mod289(i);
+					vec4 p = permute(permute(permute(i.z + vec4(0.0, i1.z, i2.z, 1.0)) + i.y + vec4(0.0, i1.y, i2.y, 1.0)) + i.x + vec4(0.0, i1.x, i2.x, 1.0));
+
+					vec3 ns = 0.142857142857 * D.wyz - D.xzx;
+					vec4 j = p - 49.0 * floor(p * ns.z * ns.z);
+					vec4 gx = floor(j * ns.z);
+					vec4 gy = floor(j - 7.0 * gx);
+					vec4 x = gx * ns.x + ns.yyyy;
+					vec4 y = gy * ns.x + ns.yyyy;
+					vec4 h = 1.0 - abs(x) - abs(y);
+					vec4 b0 = vec4(x.xy, y.xy);
+					vec4 b1 = vec4(x.zw, y.zw);
+					vec4 s0 = floor(b0) * 2.0 + 1.0;
+					vec4 s1 = floor(b1) * 2.0 + 1.0;
+					vec4 sh = -step(h, vec4(0.0));
+					vec4 a0 = b0.xzyw + s0.xzyw * sh.xxyy;
+					vec4 a1 = b1.xzyw + s1.xzyw * sh.zzww;
+					vec3 p0 = vec3(a0.xy, h.x);
+					vec3 p1 = vec3(a0.zw, h.y);
+					vec3 p2 = vec3(a1.xy, h.z);
+					vec3 p3 = vec3(a1.zw, h.w);
+					vec4 norm = taylorInvSqrt(vec4(dot(p0, p0), dot(p1, p1), dot(p2, p2), dot(p3, p3)));
+					p0 *= norm.x;
+					p1 *= norm.y;
+					p2 *= norm.z;
+					p3 *= norm.w;
+
+					vec4 m = max(0.6 - vec4(dot(x0, x0), dot(x1, x1), dot(x2, x2), dot(x3, x3)), 0.0);
+					m = m * m;
+					return 42.0 * dot(m * m, vec4(dot(p0, x0), dot(p1, x1), dot(p2, x2), dot(p3, x3)));
+				}
+
+				// ofNoise(i * scale / size, time / period, channel) for texel i
+				vec3 lut(float texel) {
+					float x = floor(texel) * noiseScale / size;
+					return vec3(snoise(vec3(x, time / 9.5123, 0.0)),
+								snoise(vec3(x, time / 11.5123, 1.0)),
+								snoise(vec3(x, time / 13.6123, 2.0))) * 0.5 + 0.5;
+				}
+
+				void main() {
+					gl_FragColor = vec4(lut(gl_TexCoord[0].s), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform float time;
+				uniform float noiseScale;
+				uniform float size;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				vec3 mod289(vec3 x) { return x - floor(x * (1.0 / 289.0)) * 289.0; }
+				vec4 mod289(vec4 x) { return x - floor(x * (1.0 / 289.0)) * 289.0; }
+				vec4 permute(vec4 x) { return mod289(((x * 34.0) + 1.0) * x); }
+				vec4 taylorInvSqrt(vec4 r) { return 1.79284291400159 - 0.85373472095314 * r; }
+
+				float snoise(vec3 v) {
+					const vec2 C = vec2(1.0 / 6.0, 1.0 / 3.0);
+					const vec4 D = vec4(0.0, 0.5, 1.0, 2.0);
+
+					vec3 i = floor(v + dot(v, C.yyy));
+					vec3 x0 = v - i + dot(i, C.xxx);
+					vec3 g = step(x0.yzx, x0.xyz);
+					vec3 l = 1.0 - g;
+					vec3 i1 = min(g.xyz, l.zxy);
+					vec3 i2 = max(g.xyz, l.zxy);
+					vec3 x1 = x0 - i1 + C.xxx;
+					vec3 x2 = x0 - i2 + C.yyy;
+					vec3 x3 = x0 - D.yyy;
+
+					i = mod289(i);
+					vec4 p = permute(permute(permute(i.z + vec4(0.0, i1.z, i2.z, 1.0)) + i.y + vec4(0.0, i1.y, i2.y, 1.0)) + i.x + vec4(0.0, i1.x, i2.x, 1.0));
+
+					vec3 ns = 0.142857142857 * D.wyz - D.xzx;
+					vec4 j = p - 49.0 * floor(p * ns.z * ns.z);
+					vec4 gx = floor(j * ns.z);
+					vec4 gy = floor(j - 7.0 * gx);
+					vec4 x = gx * ns.x + ns.yyyy;
+					vec4 y = gy * ns.x + ns.yyyy;
+					vec4 h = 1.0 - abs(x) - abs(y);
+					vec4 b0 = vec4(x.xy, y.xy);
+					vec4 b1 = vec4(x.zw, y.zw);
+					vec4 s0 = floor(b0) * 2.0 + 1.0;
+					vec4 s1 = floor(b1) * 2.0 + 1.0;
+					vec4 sh = -step(h, vec4(0.0));
+					vec4 a0 = b0.xzyw + s0.xzyw * sh.xxyy;
+					vec4 a1 = b1.xzyw + s1.xzyw * sh.zzww;
+					vec3 p0 = vec3(a0.xy, h.x);
+					vec3 p1 = vec3(a0.zw, h.y);
+					vec3 p2 = vec3(a1.xy, h.z);
+					vec3 p3 = vec3(a1.zw, h.w);
+					vec4 norm = taylorInvSqrt(vec4(dot(p0, p0), dot(p1, p1), dot(p2, p2), dot(p3, p3)));
+					p0 *= norm.x;
+					p1 *= norm.y;
+					p2 *= norm.z;
+					p3 *= norm.w;
+
+					vec4 m = max(0.6 - vec4(dot(x0, x0), dot(x1, x1), dot(x2, x2), dot(x3, x3)), 0.0);
+					m = m * m;
+					return 42.0 * dot(m * m, vec4(dot(p0, x0), dot(p1, x1), dot(p2, x2), dot(p3, x3)));
+				}
+
+				// ofNoise(i * scale / size, time / period, channel) for texel i
+				vec3 lut(float texel) {
+					float x = floor(texel) * noiseScale / size;
+					return vec3(snoise(vec3(x, time / 9.5123, 0.0)),
+								snoise(vec3(x, time / 11.5123, 1.0)),
+								snoise(vec3(x, time / 13.6123, 2.0))) * 0.5 + 0.5;
+				}
+
+				void main() {
+					fragColor = vec4(lut(texCoordVarying.x), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		void update(ofFbo& dest, float _time, float _noiseScale) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniform1f("time", _time);
+			shader.setUniform1f("noiseScale", _noiseScale);
+			shader.setUniform1f("size", dest.getWidth());
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Draws a source through a remap texture: every destination pixel fetches the source at the normalized
+	// coordinate the remap holds for it (see ofxCameraRemap). Outside 0..1 is black.
+	class ftRemapShader : public ftShader {
+	public:
+		ftRemapShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect sourceTex;
+				uniform sampler2DRect remapTex;
+				uniform vec2 sourceSize;
+				uniform vec2 remapScale; // dest to remap pixels
+
+				void main() {
+					vec2 coord = texture2DRect(remapTex, gl_TexCoord[0].st * remapScale).rg;
+					if (any(lessThan(coord, vec2(0.0))) || any(greaterThan(coord, vec2(1.0))))
+						gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+					else
+						gl_FragColor = vec4(texture2DRect(sourceTex, coord * sourceSize).rgb, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect sourceTex;
+				uniform sampler2DRect remapTex;
+				uniform vec2 sourceSize;
+				uniform vec2 remapScale; // dest to remap pixels
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				void main() {
+					vec2 coord = texture(remapTex, texCoordVarying * remapScale).rg;
+					if (any(lessThan(coord, vec2(0.0))) || any(greaterThan(coord, vec2(1.0))))
+						fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+					else
+						fragColor = vec4(texture(sourceTex, coord * sourceSize).rgb, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		void update(ofFbo& dest, ofTexture& _sourceTex, ofTexture& _remapTex) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("sourceTex", _sourceTex, 0);
+			shader.setUniformTexture("remapTex", _remapTex, 1);
+			shader.setUniform2f("sourceSize", _sourceTex.getWidth(), _sourceTex.getHeight());
+			shader.setUniform2f("remapScale", _remapTex.getWidth() / dest.getWidth(), _remapTex.getHeight() / dest.getHeight());
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+
+	// Successive halvings of the processed camera frame, built once per new frame so every pass that reads the
+	// frame at a lower resolution takes a level near its own size instead of resampling the full frame itself.
+	// Drawing into half the size with linear filtering averages each 2x2 block, so every level is box filtered
+	// from the one above it. Level 0 is the frame itself.
+	class ftSourcePyramid {
+	public:
+		ftSourcePyramid() : source(NULL) {}
+
+		void setup(int _width, int _height, int _numLevels) {
+			levels.resize(MAX(_numLevels - 1, 0));
+			int width = _width;
+			int height = _height;
+			for (size_t i = 0; i < levels.size(); i++) {
+				width = MAX(width / 2, 1);
+				height = MAX(height / 2, 1);
+				levels[i].allocate(width, height);
+				levels[i].black();
+			}
+		}
+
+		void update(ofTexture& _source) {
+			source = &_source;
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			ofTexture* above = source;
+			for (size_t i = 0; i < levels.size(); i++) {
+				levels[i].begin();
+				above->draw(0, 0, levels[i].getWidth(), levels[i].getHeight());
+				levels[i].end();
+				above = &levels[i].getTexture();
+			}
+			ofPopStyle();
+		}
+
+		int getNumLevels() const { return levels.size() + 1; }
+
+		ofTexture& getLevel(int _level) {
+			if (_level <= 0 || levels.empty())
+				return *source;
+			return levels[MIN(_level, (int)levels.size()) - 1].getTexture();
+		}
+
+		// The smallest level at least _width x _height: scaling it down the rest of the way skips no texels
+		ofTexture& getLevel(int _width, int _height) {
+			int level = 0;
+			while (level < (int)levels.size() && levels[level].getWidth() >= _width && levels[level].getHeight() >= _height) {
+				level++;
+			}
+			return getLevel(level);
+		}
+
+	protected:
+		ofTexture*		source;
+		vector<ftFbo>	levels; // level 1 and down
+	};
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Stitches up to MAX_CAMERAS raw PS3Eye frames side by side into one texture in a single pass.
+	// Frames are uploaded as YUYV (GL_RGBA8 at half width: Y0 U Y1 V per texel) and converted here,
+	// each camera is placed by a rect in destination pixels and cross faded over feather pixels at its edges.
+	class ftStitchShader : public ftShader {
+	public:
+		static const int MAX_CAMERAS = 4;
+
+		ftStitchShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect tex0;
+				uniform sampler2DRect tex1;
+				uniform sampler2DRect tex2;
+				uniform sampler2DRect tex3;
+				uniform int numCameras;
+				uniform vec4 rects[4];
+				uniform vec2 cameraSize;
+				uniform float feather;
+
+				vec3 yuyvToRgb(sampler2DRect tex, vec2 pos) {
+					vec4 texel = texture2DRect(tex, vec2(floor(pos.x * 0.5) + 0.5, pos.y));
+					float y = (mod(floor(pos.x), 2.0) < 0.5) ? texel.r : texel.b;
+					y = 1.164 * (y - 0.0625);
+					float u = texel.g - 0.5;
+					float v = texel.a - 0.5;
+					return vec3(y + 1.596 * v, y - 0.391 * u - 0.813 * v, y + 2.018 * u);
+				}
+
+				vec4 sampleCamera(sampler2DRect tex, vec4 rect, vec2 pos) {
+					vec2 local = (pos - rect.xy) / rect.zw;
+					if (any(lessThan(local, vec2(0.0))) || any(greaterThan(local, vec2(1.0))))
+						return vec4(0.0);
+					float edge = min(pos.x - rect.x, rect.x + rect.z - pos.x);
+					float weight = (feather > 0.0) ? max(clamp(edge / feather, 0.0, 1.0), 0.0001) : 1.0;
+					return vec4(yuyvToRgb(tex, local * cameraSize) * weight, weight);
+				}
+
+				void main() {
+					vec2 pos = gl_TexCoord[0].st;
+					vec4 sum = sampleCamera(tex0, rects[0], pos);
+					if (numCameras > 1) sum += sampleCamera(tex1, rects[1], pos);
+					if (numCameras > 2) sum += sampleCamera(tex2, rects[2], pos);
+					if (numCameras > 3) sum += sampleCamera(tex3, rects[3], pos);
+					gl_FragColor = (sum.a > 0.0) ? vec4(sum.rgb / sum.a, 1.0) : vec4(0.0, 0.0, 0.0, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect tex0;
+				uniform sampler2DRect tex1;
+				uniform sampler2DRect tex2;
+				uniform sampler2DRect tex3;
+				uniform int numCameras;
+				uniform vec4 rects[4];
+				uniform vec2 cameraSize;
+				uniform float feather;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				vec3 yuyvToRgb(sampler2DRect tex, vec2 pos) {
+					vec4 texel = texture(tex, vec2(floor(pos.x * 0.5) + 0.5, pos.y));
+					float y = (mod(floor(pos.x), 2.0) < 0.5) ? texel.r : texel.b;
+					y = 1.164 * (y - 0.0625);
+					float u = texel.g - 0.5;
+					float v = texel.a - 0.5;
+					return vec3(y + 1.596 * v, y - 0.391 * u - 0.813 * v, y + 2.018 * u);
+				}
+
+				// weighted color of one camera, the weight ramps up over feather pixels from the left/right edges
+				vec4 sampleCamera(sampler2DRect tex, vec4 rect, vec2 pos) {
+					vec2 local = (pos - rect.xy) / rect.zw;
+					if (any(lessThan(local, vec2(0.0))) || any(greaterThan(local, vec2(1.0))))
+						return vec4(0.0);
+					float edge = min(pos.x - rect.x, rect.x + rect.z - pos.x);
+					float weight = (feather > 0.0) ? max(clamp(edge / feather, 0.0, 1.0), 0.0001) : 1.0;
+					return vec4(yuyvToRgb(tex, local * cameraSize) * weight, weight);
+				}
+
+				void main() {
+					vec2 pos = texCoordVarying;
+					vec4 sum = sampleCamera(tex0, rects[0], pos);
+					if (numCameras > 1) sum += sampleCamera(tex1, rects[1], pos);
+					if (numCameras > 2) sum += sampleCamera(tex2, rects[2], pos);
+					if (numCameras > 3) sum += sampleCamera(tex3, rects[3], pos);
+					fragColor = (sum.a > 0.0) ? vec4(sum.rgb / sum.a, 1.0) : vec4(0.0, 0.0, 0.0, 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		// _yuyvTextures are half width GL_RGBA8 textures, _rects are (x, y, width, height) in dest pixels
+		void update(ofFbo& dest, vector<ofTexture*>& _yuyvTextures, vector<ofRectangle>& _rects, float _cameraWidth, float _cameraHeight, float _feather) {
+			int numCameras = MIN((int)_yuyvTextures.size(), MAX_CAMERAS);
+			if (numCameras == 0)
+				return;
+
+			float rects[MAX_CAMERAS * 4] = { 0 };
+			for (int i = 0; i < numCameras; i++) {
+				rects[i * 4 + 0] = _rects[i].x;
+				rects[i * 4 + 1] = _rects[i].y;
+				rects[i * 4 + 2] = _rects[i].width;
+				rects[i * 4 + 3] = _rects[i].height;
+			}
+
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			// unused samplers still need a valid texture bound
+			for (int i = 0; i < MAX_CAMERAS; i++) {
+				shader.setUniformTexture("tex" + ofToString(i), *_yuyvTextures[i < numCameras ? i : 0], i);
+			}
+			shader.setUniform1i("numCameras", numCameras);
+			shader.setUniform4fv("rects", rects, MAX_CAMERAS);
+			shader.setUniform2f("cameraSize", _cameraWidth, _cameraHeight);
+			shader.setUniform1f("feather", _feather);
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
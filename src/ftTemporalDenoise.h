@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ftTemporalDenoiseShader.h"
+
+namespace flowTools {
+
+	// Takes the sensor noise out of a source before recolor and the optical flow see it, at the source's own
+	// resolution, so still scenes don't inject velocity. One instance per kind of input, each with its own
+	// settings: depth (16 bit, with hole filling) or color / IR. A single pass per frame, the output is the
+	// history for the next one.
+	class ftTemporalDenoise {
+	public:
+		ftTemporalDenoise() : current(0), initialized(false), depth(false) {}
+
+		void setup(string _name, bool _depth) {
+			depth = _depth;
+			parameters.setName(_name);
+			parameters.add(enabled.set("Denoise", false));
+			parameters.add(strength.set("Strength", 0.8, 0, 0.98));
+			// depth is raw millimeters over 16 bits, 0.003 is about 20 cm
+			parameters.add(motionThreshold.set("Motion threshold", depth ? 0.003 : 0.08, 0, depth ? 0.02 : 0.5));
+			if (depth) {
+				parameters.add(holeFill.set("Fill holes", true));
+				parameters.add(holeRadius.set("Hole radius", 2, 1, 8));
+			}
+		}
+
+		// the next frame starts a new history, e.g. after the source changed
+		void reset() { initialized = false; }
+
+		ofTexture& update(ofTexture& source) {
+			int width = source.getWidth();
+			int height = source.getHeight();
+			if (!historyFbos[0].isAllocated() || historyFbos[0].getWidth() != width || historyFbos[0].getHeight() != height) {
+				for (int i = 0; i < 2; i++) {
+					historyFbos[i].allocate(width, height, depth ? GL_R16 : GL_RGB);
+					if (depth) {
+						historyFbos[i].getTexture().setRGToRGBASwizzles(true);
+					}
+				}
+				initialized = false;
+			}
+			int previous = current;
+			current = 1 - current;
+			// without a history the frame is its own
+			ofTexture& history = initialized ? historyFbos[previous].getTexture() : source;
+			shader.update(historyFbos[current], source, history, strength, motionThreshold, depth, depth && holeFill, holeRadius);
+			initialized = true;
+			return historyFbos[current].getTexture();
+		}
+
+		bool isEnabled() { return enabled.get(); }
+
+		ofParameterGroup	parameters;
+		ofParameter<bool>	enabled;
+		ofParameter<float>	strength; // weight of the history where nothing moves
+		ofParameter<float>	motionThreshold; // change that counts as movement, in the source's 0..1 values
+		ofParameter<bool>	holeFill;
+		ofParameter<float>	holeRadius; // pixels
+
+	protected:
+		int		current;
+		bool	initialized;
+		bool	depth;
+
+		ftFbo	historyFbos[2];
+
+		ftTemporalDenoiseShader shader;
+	};
+}
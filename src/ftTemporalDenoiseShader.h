@@ -0,0 +1,128 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Motion adaptive recursive filter: every pixel is blended with its filtered history, the more the less
+	// it changed, so noise is averaged out and movement passes through. For depth a zero is a hole, it is
+	// filled with the farthest valid depth around it (holes are mostly shadows next to a nearer edge) or else
+	// with the history.
+	class ftTemporalDenoiseShader : public ftShader {
+	public:
+		ftTemporalDenoiseShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect currentTex;
+				uniform sampler2DRect historyTex;
+				uniform float strength;
+				uniform float motionThreshold;
+				uniform float isDepth;
+				uniform float holeFill;
+				uniform float holeRadius;
+
+				float fillHole(vec2 pos, float history) {
+					float fill = 0.0;
+					for (int y = -1; y <= 1; y++) {
+						for (int x = -1; x <= 1; x++) {
+							fill = max(fill, texture2DRect(currentTex, pos + vec2(x, y) * holeRadius).r);
+						}
+					}
+					return (fill > 0.0) ? fill : history;
+				}
+
+				void main() {
+					vec2 pos = gl_TexCoord[0].st;
+					vec4 current = texture2DRect(currentTex, pos);
+					vec4 history = texture2DRect(historyTex, pos);
+					if (isDepth > 0.5 && holeFill > 0.5) {
+						if (current.r == 0.0)
+							current.r = fillHole(pos, history.r);
+						if (history.r == 0.0)
+							history = current;
+					}
+					float motion = (isDepth > 0.5) ? abs(current.r - history.r) : length(current.rgb - history.rgb);
+					float weight = strength * (1.0 - smoothstep(0.5 * motionThreshold, motionThreshold, motion));
+					gl_FragColor = vec4(mix(current.rgb, history.rgb, weight), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect currentTex;
+				uniform sampler2DRect historyTex;
+				uniform float strength;
+				uniform float motionThreshold;
+				uniform float isDepth;
+				uniform float holeFill;
+				uniform float holeRadius;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				float fillHole(vec2 pos, float history) {
+					float fill = 0.0;
+					for (int y = -1; y <= 1; y++) {
+						for (int x = -1; x <= 1; x++) {
+							fill = max(fill, texture(currentTex, pos + vec2(x, y) * holeRadius).r);
+						}
+					}
+					return (fill > 0.0) ? fill : history;
+				}
+
+				void main() {
+					vec2 pos = texCoordVarying;
+					vec4 current = texture(currentTex, pos);
+					vec4 history = texture(historyTex, pos);
+					if (isDepth > 0.5 && holeFill > 0.5) {
+						if (current.r == 0.0)
+							current.r = fillHole(pos, history.r);
+						// nothing to blend with where the history is a hole
+						if (history.r == 0.0)
+							history = current;
+					}
+					float motion = (isDepth > 0.5) ? abs(current.r - history.r) : length(current.rgb - history.rgb);
+					float weight = strength * (1.0 - smoothstep(0.5 * motionThreshold, motionThreshold, motion));
+					fragColor = vec4(mix(current.rgb, history.rgb, weight), 1.0);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		// _holeFill only for depth, _holeRadius in pixels
+		void update(ofFbo& dest, ofTexture& _currentTex, ofTexture& _historyTex, float _strength, float _motionThreshold, bool _isDepth, bool _holeFill, float _holeRadius) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("currentTex", _currentTex, 0);
+			shader.setUniformTexture("historyTex", _historyTex, 1);
+			shader.setUniform1f("strength", _strength);
+			shader.setUniform1f("motionThreshold", _motionThreshold);
+			shader.setUniform1f("isDepth", _isDepth ? 1.0 : 0.0);
+			shader.setUniform1f("holeFill", _holeFill ? 1.0 : 0.0);
+			shader.setUniform1f("holeRadius", _holeRadius);
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
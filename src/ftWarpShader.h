@@ -0,0 +1,80 @@
+#pragma once
+#include "ofMain.h"
+#include "ftShader.h"
+#include "ftFbo.h"
+
+namespace flowTools {
+	// Moves a frame along a velocity field: every destination pixel fetches the source from where the
+	// velocity says it came from, displacement (in destination pixels per velocity unit) ago.
+	class ftWarpShader : public ftShader {
+	public:
+		ftWarpShader() {
+
+			if (ofIsGLProgrammableRenderer())
+				glThree();
+			else
+				glTwo();
+		}
+
+	protected:
+		void glTwo() {
+			fragmentShader = GLSL120(
+				uniform sampler2DRect sourceTex;
+				uniform sampler2DRect velocityTex;
+				uniform vec2 sourceScale;
+				uniform vec2 velocityScale;
+				uniform vec2 displacement;
+
+				void main() {
+					vec2 pos = gl_TexCoord[0].st;
+					vec2 velocity = texture2DRect(velocityTex, pos * velocityScale).xy;
+					gl_FragColor = texture2DRect(sourceTex, (pos - velocity * displacement) * sourceScale);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.linkProgram();
+		}
+
+		void glThree() {
+			fragmentShader = GLSL150(
+				uniform sampler2DRect sourceTex;
+				uniform sampler2DRect velocityTex;
+				uniform vec2 sourceScale;
+				uniform vec2 velocityScale;
+				uniform vec2 displacement;
+
+				in vec2 texCoordVarying;
+				out vec4 fragColor;
+
+				void main() {
+					vec2 pos = texCoordVarying;
+					vec2 velocity = texture(velocityTex, pos * velocityScale).xy;
+					fragColor = texture(sourceTex, (pos - velocity * displacement) * sourceScale);
+				}
+			);
+
+			shader.setupShaderFromSource(GL_VERTEX_SHADER, vertexShader);
+			shader.setupShaderFromSource(GL_FRAGMENT_SHADER, fragmentShader);
+			shader.bindDefaults();
+			shader.linkProgram();
+		}
+
+	public:
+		void update(ofFbo& dest, ofTexture& _sourceTex, ofTexture& _velocityTex, ofVec2f _displacement) {
+			ofPushStyle();
+			ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+			dest.begin();
+			shader.begin();
+			shader.setUniformTexture("sourceTex", _sourceTex, 0);
+			shader.setUniformTexture("velocityTex", _velocityTex, 1);
+			shader.setUniform2f("sourceScale", _sourceTex.getWidth() / dest.getWidth(), _sourceTex.getHeight() / dest.getHeight());
+			shader.setUniform2f("velocityScale", _velocityTex.getWidth() / dest.getWidth(), _velocityTex.getHeight() / dest.getHeight());
+			shader.setUniform2f("displacement", _displacement.x, _displacement.y);
+			renderFrame(dest.getWidth(), dest.getHeight());
+			shader.end();
+			dest.end();
+			ofPopStyle();
+		}
+	};
+}
@@ -56,6 +56,36 @@ int main(int argc, char** argv) {
 #endif
 	bool isShouldStartPsCam = false;
 	ofGLFWWindowSettings windowSettings;
+	// --render <session.vqs|video|folder> [--out renders] [--fps 60] [--duration sec] [--format png]
+	ofxOfflineRender::Settings offlineSettings;
+	// --profile <name> picks a profile of resolution.xml
+	string resolutionProfileName;
+	// --kinect-recording <session.vqs> stands in for the kinect where there is none
+	string kinectRecording;
+#ifndef WIN_APP
+	// every option takes a value, a missing value or an unknown option is reported and skipped
+	for (int i = 1; i < argc; i++) {
+		string option = argv[i];
+		bool isKnown = option == "--render" || option == "--out" || option == "--fps" || option == "--duration" ||
+			option == "--format" || option == "--profile" || option == "--kinect-recording";
+		if (!isKnown) {
+			fprintf(stderr, "unknown option %s\n", option.c_str());
+			continue;
+		}
+		if (i + 1 >= argc || string(argv[i + 1]).compare(0, 2, "--") == 0) {
+			fprintf(stderr, "option %s needs a value\n", option.c_str());
+			continue;
+		}
+		string value = argv[++i];
+		if (option == "--render") offlineSettings.input = value;
+		else if (option == "--out") offlineSettings.output = value;
+		else if (option == "--fps") offlineSettings.fps = ofToFloat(value);
+		else if (option == "--duration") offlineSettings.duration = ofToFloat(value);
+		else if (option == "--format") offlineSettings.format = value;
+		else if (option == "--profile") resolutionProfileName = value;
+		else if (option == "--kinect-recording") kinectRecording = value;
+	}
+#endif
 #ifdef USE_PROGRAMMABLE_GL
 	windowSettings.setGLVersion(4, 1);
 #endif
@@ -102,11 +132,20 @@ int main(int argc, char** argv) {
     oscPort = PS_PORT;
 #endif
     
+	// the render goes into an fbo, the window only previews it
+	if (!offlineSettings.input.empty()) {
+		windowSettings.windowMode = OF_WINDOW;
+		windowSettings.width = 640;
+		windowSettings.height = 360;
+	}
     ofCreateWindow(windowSettings);
     
 	ofApp* app = new ofApp();
     app->oscPort = oscPort;
 	app->shouldStartPsEyeCam = isShouldStartPsCam;
+	app->offlineSettings = offlineSettings;
+	app->resolutionProfileName = resolutionProfileName;
+	app->kinectRecording = kinectRecording;
 #ifdef _WIN32
     setAppPath(app);
 #else
@@ -1,12 +1,5 @@
 #include "ofApp.h"
 
-static const int ITUR_BT_601_CY = 1220542;
-static const int ITUR_BT_601_CUB = 2116026;
-static const int ITUR_BT_601_CUG = -409993;
-static const int ITUR_BT_601_CVG = -852492;
-static const int ITUR_BT_601_CVR = 1673527;
-static const int ITUR_BT_601_SHIFT = 20;
-
 #define TIMEOUT_KINECT_PEOPLE_FILTER 60
 #define TIMEIN_KINECT_PEOPLE_FILTER 60
 #define AUTO_PILOT_TIMEOUT 300
@@ -37,125 +30,345 @@ void ofApp::setup() {
 	ofSetVerticalSync(false);
 	ofSetLogLevel(OF_LOG_NOTICE);
 
-	internalWidth = 1280;
-	internalHeight = 720;
-	// process all but the density on 16th resolution
-	flowWidth = internalWidth / 4;
-	flowHeight = internalHeight / 4;
+	// OFFLINE RENDER
+	offlineRender.setup(offlineSettings);
+	if (offlineRender.isEnabled()) {
+		// as fast as the frames can be computed, on a virtual clock
+		ofSetFrameRate(0);
+		clock.setFixedStep(offlineRender.getStep());
+		ofSeedRandom(0);
+	}
+
+	// RESOLUTION
+	resolution.load("resolution.xml", resolutionProfileName);
+	internalWidth = resolution.width;
+	internalHeight = resolution.height;
+	sourceWidth = resolution.getWidth(resolution.source);
+	sourceHeight = resolution.getHeight(resolution.source);
+	// by default all but the density on 16th resolution
+	flowWidth = resolution.getWidth(resolution.flow);
+	flowHeight = resolution.getHeight(resolution.flow);
+	maskWidth = resolution.getWidth(resolution.mask);
+	maskHeight = resolution.getHeight(resolution.mask);
+	int densityWidth = resolution.getWidth(resolution.density);
+	int densityHeight = resolution.getHeight(resolution.density);
+	int particlesWidth = resolution.getWidth(resolution.particles);
+	int particlesHeight = resolution.getHeight(resolution.particles);
+	int fieldWidth = MAX((int)(flowWidth * resolution.visualizers), 1);
+	int fieldHeight = MAX((int)(flowHeight * resolution.visualizers), 1);
 
 	// FLOW & MASK
 	opticalFlow.setup(flowWidth, flowHeight);
-	velocityMask.setup(internalWidth, internalHeight);
+	velocityMask.setup(maskWidth, maskHeight);
+	backgroundModel.setup(flowWidth, flowHeight, sourceWidth, sourceHeight);
+	presence.setup();
+	cameraRemap.setup(sourceWidth / 4, sourceHeight / 4);
+	frameInterpolator.setup(flowWidth, flowHeight);
+	flowCache.setup(flowWidth, flowHeight);
+	isFlowFromCache = false;
+	flowInput = NULL;
+	depthDenoise.setup("denoise depth", true);
+	cameraDenoise.setup("denoise camera", false);
+	hasBodyIndex = false;
+	timeSinceLastTimeAPersonWasInFrame = clock.getElapsedTimef() - TIMEOUT_KINECT_PEOPLE_FILTER;
 
 	// FLUID & PARTICLES
-	fluidSimulation.setup(flowWidth, flowHeight, internalWidth, internalHeight);
-	particleFlow.setup(flowWidth, flowHeight, internalWidth, internalHeight);
+	fluidSimulation.setup(flowWidth, flowHeight, densityWidth, densityHeight);
+	particleFlow.setup(flowWidth, flowHeight, particlesWidth, particlesHeight);
 
 	logoImage.load("watermark.png");
 //    if(showLogo) {
 //        fluidSimulation.addObstacle(logoImage.getTexture());
 //    }
 
-	velocityDots.setup(flowWidth / 4, flowHeight / 4);
+	velocityDots.setup(fieldWidth, fieldHeight);
 
 	// VISUALIZATION
 	displayScalar.setup(flowWidth, flowHeight);
-	velocityField.setup(flowWidth / 4, flowHeight / 4);
-	temperatureField.setup(flowWidth / 4, flowHeight / 4);
-	pressureField.setup(flowWidth / 4, flowHeight / 4);
-	velocityTemperatureField.setup(flowWidth / 4, flowHeight / 4);
-	velocityOffset.allocate(flowWidth / 2, flowHeight / 2);
+	velocityField.setup(fieldWidth, fieldHeight);
+	temperatureField.setup(fieldWidth, fieldHeight);
+	pressureField.setup(fieldWidth, fieldHeight);
+	velocityTemperatureField.setup(fieldWidth, fieldHeight);
+	velocityOffset.allocate(fieldWidth * 2, fieldHeight * 2);
 
 	// MOUSE DRAW
-	mouseForces.setup(flowWidth, flowHeight, internalWidth, internalHeight);
+	mouseForces.setup(flowWidth, flowHeight, densityWidth, densityHeight);
 
 	// CAMERA
-	simpleCam.setup(640, 480, true);
-    
-    
+	// the source manager opens the sources once they are selected or about to be
+	webcamSource.setup(640, 480);
+	psEyeRig.setup(sourceWidth, sourceHeight, 60);
+	// a folder of clips plays as a playlist, the single video.mov loops otherwise
+	videoSource.setup(ofDirectory::doesDirectoryExist("videos") ? "videos" : "video.mov");
+	sourceManager.add(webcamSource);
+#ifndef _KINECT
+	kinectSource.setup(kinectRecording);
+#endif
+	sourceManager.add(kinectSource);
+	sourceManager.add(psEyeSource);
+	sourceManager.add(psEyeRig);
+	sourceManager.add(videoSource);
+#ifdef TARGET_LINUX
+	sourceManager.add(pipelineSource);
+#endif
+	sourceManager.add(sessionSource);
+	dualSource.setup(sourceWidth, sourceHeight);
+	sourceManager.add(dualSource);
+	sourceManager.setup([this](int mode) -> ofxFrameSource& { return getSource(mode); },
+						[this](int mode, bool speculative) { return openSource(mode, speculative); });
+	// sessions record the active source, see ofxSourceManager::record()
+	sourceManager.setRecorder(&sessionRecorder);
+	nextSettingsSourceMode = -1;
 
-#ifdef _KINECT
 	// KINECT
-	kinect.open();
-	kinect.initDepthSource();
-	kinect.initColorSource();
-	kinect.initInfraredSource();
-	kinect.initBodySource();
-	kinect.initBodyIndexSource();
-	kinectFbo.allocate(internalWidth, internalHeight, GL_R16);
+	kinectFbo.allocate(sourceWidth, sourceHeight, GL_R16);
 	kinectFbo.getTexture().setRGToRGBASwizzles(true);
-	ofLogError("kinect inited");
-#endif
 
 	didCamUpdate = false;
-	cameraFbo.allocate(internalWidth, internalHeight);
+	processedSource = NULL;
+	processedSequence = 0;
+	processedTime = 0;
+	cameraFbo.allocate(sourceWidth, sourceHeight);
 	cameraFbo.black();
+	cameraPyramid.setup(sourceWidth, sourceHeight, 5);
+	cameraPyramid.update(cameraFbo.getTexture());
 
 	globalFbo.allocate(internalWidth, internalHeight);
 
-	recolor.setup();
+	recolor.setup(resolution.lut);
 
 	// GUI
 	setupGui();
 
-	lastTime = ofGetElapsedTimef();
+    lastOscMessageTime = clock.getElapsedTimef();
+	if (offlineRender.isEnabled()) {
+		setupOfflineRender();
+		return;
+	}
 
 	doFullScreen.set(1);
     
 	oscReceiver.setup(oscPort);
-    lastOscMessageTime = ofGetElapsedTimef();
 	if (shouldStartPsEyeCam) {
 		sourceMode = SOURCE_PS3EYE;
 	}
 }
-void ofApp::setupPsEye() {
+
+// Renders are repeatable: the input is replayed on the virtual clock and no live OSC is taken
+void ofApp::setupOfflineRender() {
+	const string& input = offlineRender.getSettings().input;
+	recordSession.set(false);
+	doFullScreen.set(false);
+	if (ofFilePath::getFileExt(input) == "vqs") {
+		sessionFile.set(input);
+		sessionStartTime.set(0);
+		sessionSource.setFixedStep(offlineRender.getStep());
+		sourceMode.set(SOURCE_SESSION);
+	}
+	else {
+		videoSource.setup(input);
+		videoSource.setFixedStep(offlineRender.getStep());
+		sourceMode.set(SOURCE_VIDEO);
+	}
+}
+
+// After the given duration, or once the input has played through
+bool ofApp::isOfflineRenderDone() {
+	const ofxOfflineRender::Settings& settings = offlineRender.getSettings();
+	if (settings.duration > 0) {
+		return clock.getFrameNum() > (uint64_t)(settings.duration * settings.fps + 0.5);
+	}
+	return isSessionSource() ? sessionSource.getLoopCount() > 0 : videoSource.getLoopCount() > 0;
+}
+// A speculative open (the source manager's pre-open) keeps an open eye as it is and takes no cameras from the rig
+bool ofApp::setupPsEye(bool speculative) {
+	if (speculative && (psEyeSource.isOpen() || psEyeRig.isOpen())) {
+		return psEyeSource.isOpen();
+	}
 	try {
 		using namespace ps3eye;
-		std::vector<PS3EYECam::PS3EYERef> devices(PS3EYECam::getDevices());
-		if (devices.size())
-		{
-			// Only stop eye if eye is working and more then one camera is connected
-			if (eye && devices.size() > 1) {
-				eye->stop();
-				//eye = NULL;
-			}
+		const std::vector<PS3EYECam::PS3EYERef>& devices = PS3EYECam::getDevices();
+		if (devices.empty()) {
+			ofLogError() << "Failed to open PS eye!";
+			return false;
+		}
 
+		if (!speculative) {
 			psEyeCameraIndex.setMax(devices.size() - 1);
-			int psEyeCameraToUse = 0;
-			if (devices.size() > psEyeCameraIndex) {
-				psEyeCameraToUse = psEyeCameraIndex;
-			}
-			
-			// Init a new eye only if eye is not set or if devices is bigger then 1
-			if (!eye || devices.size() > 1) {
-				eye = devices.at(psEyeCameraToUse);
-				bool res = eye->init(640, 480, 60);
-				if (res) {
-					eye->start();
-					eye->setExposure(125); //TODO: was 255
-					eye->setAutogain(useAgc);
-
-					videoFrame = new unsigned char[eye->getWidth()*eye->getHeight() * 4];
-					videoTexture.allocate(eye->getWidth(), eye->getHeight(), GL_RGB);
-				}
-				else {
-					eye = NULL;
-				}
-			}
 		}
-		else {
-			ofLogError() << "Failed to open PS eye!";
+		int psEyeCameraToUse = 0;
+		if (devices.size() > psEyeCameraIndex) {
+			psEyeCameraToUse = psEyeCameraIndex;
+		}
+
+		// Restart the eye only if another camera or format was asked for
+		if (psEyeSource.isOpen() && psEyeSource.getDeviceIndex() == psEyeCameraToUse && psEyeSource.isRawBayer() == psEyeRawBayer) {
+			return true;
+		}
+		psEyeSource.close();
+		psEyeSource.setDeviceIndex(psEyeCameraToUse);
+		psEyeSource.setRawBayer(psEyeRawBayer);
+		if (!psEyeSource.open()) {
+			return false;
 		}
+
+		PS3EYECam::PS3EYERef eye = psEyeSource.getEye();
+		eye->setExposure(125); //TODO: was 255
+		eye->setAutogain(useAgc && !psEyeSoftwareAec);
+		eye->setAutoExposureTarget(psEyeAecTarget);
+		eye->setAutoExposureSpeed(psEyeAecSpeed);
+		eye->setSoftwareAutoExposure(psEyeSoftwareAec);
+		return true;
 	}
 	catch (...) {
 		ofLogError() << "Failed to open PS eye. Exception.";
-		sourceMode.set((sourceMode.get() + 1) % SOURCE_COUNT);
+		return false;
 	}
 }
 
-void ofApp::setupVideoSource() {
-	videoPlayer.loadAsync("video.mov");
-	videoPlayer.play();
+// A speculative open takes no camera from the single eye and doesn't fall back to it
+bool ofApp::setupPsEyeRig(bool speculative) {
+	if (speculative && psEyeSource.isOpen()) {
+		return false;
+	}
+	// the rig opens every camera itself
+	psEyeSource.close();
+	if (!psEyeRig.open()) {
+		if (speculative) {
+			return false;
+		}
+		ofLogError() << "Failed to open PS eye rig. Falling back to a single camera";
+		psEyeMultiCamera.set(false);
+		return setupPsEye();
+	}
+	return true;
+}
+
+bool ofApp::setupVideoSource() {
+	// loads and decodes on its own threads
+	return videoSource.open();
+}
+
+// The sensor on windows. Elsewhere only with a recording to stand in for it, the kinect modes are the webcam otherwise
+bool ofApp::hasKinect() {
+#ifdef _KINECT
+	return true;
+#else
+	return !kinectRecording.empty();
+#endif
+}
+
+ofxFrameSource& ofApp::getSource(int mode) {
+	switch (mode) {
+	case SOURCE_KINECT:
+		if (!hasKinect()) {
+			return webcamSource;
+		}
+		return kinectSource;
+	case SOURCE_PS3EYE:
+		if (psEyeMultiCamera) {
+			return psEyeRig;
+		}
+		return psEyeSource;
+	case SOURCE_VIDEO:
+		return videoSource;
+#ifdef TARGET_LINUX
+	case SOURCE_PIPELINE:
+		return pipelineSource;
+#endif
+	case SOURCE_SESSION:
+		return sessionSource;
+	case SOURCE_KINECT_PSEYE:
+		if (!hasKinect()) {
+			return webcamSource;
+		}
+		return dualSource;
+	default:
+		return webcamSource;
+	}
+}
+
+// The autopilot loads the next settings file, which carries its own source mode. Otherwise the
+// operator is expected to cycle on with z
+int ofApp::predictNextSourceMode() {
+	if (doJumpBetweenStates) {
+		string key = relateiveDataPath + ofToString(loadSettingsFileIndex.get());
+		if (key != nextSettingsKey) {
+			nextSettingsKey = key;
+			nextSettingsSourceMode = -1;
+			ofxXmlSettings nextSettings;
+			if (nextSettings.load(relateiveDataPath + "settings" + std::to_string(getNextSettingsCounter()) + ".xml")) {
+				nextSettingsSourceMode = nextSettings.getValue("settings:" + sourceMode.getEscapedName(), -1);
+			}
+		}
+		if (nextSettingsSourceMode >= 0 && nextSettingsSourceMode < SOURCE_COUNT && nextSettingsSourceMode != sourceMode &&
+			isSourceAvailable(nextSettingsSourceMode)) {
+			return nextSettingsSourceMode;
+		}
+	}
+	return getNextSourceMode();
+}
+
+// Whether a mode has anything to open on this build and with these files. Without the kinect its modes are the
+// webcam, the first of them stands for it and the dual mode is left out. Cameras that aren't plugged in are
+// found out by opening them, the source manager retries those less and less often
+bool ofApp::isSourceAvailable(int mode) {
+	switch (mode) {
+	case SOURCE_KINECT:
+		return true;
+	case SOURCE_PIPELINE:
+#ifdef TARGET_LINUX
+		return true;
+#else
+		return false;
+#endif
+	case SOURCE_VIDEO:
+		return !videoSource.getPlaylist().empty() && ofFile::doesFileExist(videoSource.getPlaylist()[0]);
+	case SOURCE_SESSION:
+		return ofFile::doesFileExist(sessionFile);
+	case SOURCE_KINECT_PSEYE:
+		return hasKinect();
+	default:
+		return mode >= 0 && mode < SOURCE_COUNT;
+	}
+}
+
+// the available mode after the current one, what z and a failed source move on to
+int ofApp::getNextSourceMode() {
+	for (int i = 1; i < SOURCE_COUNT; i++) {
+		int mode = (sourceMode.get() + i) % SOURCE_COUNT;
+		if (isSourceAvailable(mode)) {
+			return mode;
+		}
+	}
+	return sourceMode.get();
+}
+
+bool ofApp::openSource(int mode, bool speculative) {
+	switch (mode) {
+	case SOURCE_PS3EYE:
+		return psEyeMultiCamera ? setupPsEyeRig(speculative) : setupPsEye(speculative);
+	case SOURCE_VIDEO:
+		return setupVideoSource();
+	case SOURCE_SESSION:
+		sessionSource.setup(sessionFile, sessionStartTime);
+		sessionSource.setSpeed(sessionSpeed);
+		return sessionSource.open();
+	case SOURCE_KINECT_PSEYE:
+		if (!hasKinect()) {
+			return webcamSource.open();
+		}
+		// both parts keep their own capture threads, the dual source only merges them
+		if (!openSource(SOURCE_KINECT, speculative) || !openSource(SOURCE_PS3EYE, speculative)) {
+			return false;
+		}
+		dualSource.setSources(kinectSource, getSource(SOURCE_PS3EYE), [this]() -> ofTexture& {
+			return filterDepthUsers(denoise(depthDenoise, kinectSource.getTexture()), kinectSource.getBodyIndexTexture(), kinectSource.getBodyCount());
+		});
+		return dualSource.open();
+	default:
+		return getSource(mode).open();
+	}
 }
 
 //for settings:recolor:cutoff will  return settings
@@ -178,46 +391,18 @@ static bool isOnlyDouble(const char* str) {
 	return true;
 }
 
-static void yuv422_to_rgba(const uint8_t *yuv_src, const int stride, uint8_t *dst, const int width, const int height)
-{
-	const int bIdx = 2;
-	const int uIdx = 0;
-	const int yIdx = 0;
-
-	const int uidx = 1 - yIdx + uIdx * 2;
-	const int vidx = (2 + uidx) % 4;
-	int j, i;
-
-#define _max(a, b) (((a) > (b)) ? (a) : (b))
-#define _saturate(v) static_cast<uint8_t>(static_cast<uint32_t>(v) <= 0xff ? v : v > 0 ? 0xff : 0)
-
-	for (j = 0; j < height; j++, yuv_src += stride)
-	{
-		uint8_t* row = dst + (width * 4) * j; // 4 channels
-
-		for (i = 0; i < 2 * width; i += 4, row += 8)
-		{
-			int u = static_cast<int>(yuv_src[i + uidx]) - 128;
-			int v = static_cast<int>(yuv_src[i + vidx]) - 128;
-
-			int ruv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVR * v;
-			int guv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVG * v + ITUR_BT_601_CUG * u;
-			int buv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CUB * u;
-
-			int y00 = _max(0, static_cast<int>(yuv_src[i + yIdx]) - 16) * ITUR_BT_601_CY;
-			row[2 - bIdx] = _saturate((y00 + ruv) >> ITUR_BT_601_SHIFT);
-			row[1] = _saturate((y00 + guv) >> ITUR_BT_601_SHIFT);
-			row[bIdx] = _saturate((y00 + buv) >> ITUR_BT_601_SHIFT);
-			row[3] = (0xff);
-
-			int y01 = _max(0, static_cast<int>(yuv_src[i + yIdx + 2]) - 16) * ITUR_BT_601_CY;
-			row[6 - bIdx] = _saturate((y01 + ruv) >> ITUR_BT_601_SHIFT);
-			row[5] = _saturate((y01 + guv) >> ITUR_BT_601_SHIFT);
-			row[4 + bIdx] = _saturate((y01 + buv) >> ITUR_BT_601_SHIFT);
-			row[7] = (0xff);
+// A stage's settings without its on/off switch, for the key of results computed through it. Switching the
+// stage on and off (e.g. by the autopilot) keeps the key
+static string getSettingsKey(ofParameterGroup& group, ofAbstractParameter& onOff) {
+	string key;
+	for (size_t i = 0; i < group.size(); i++) {
+		if (group.get(i).getName() != onOff.getName()) {
+			key += group.get(i).getName() + "=" + group.get(i).toString() + ";";
 		}
 	}
+	return key;
 }
+
 //--------------------------------------------------------------
 void ofApp::setupGui() {
 	gui.setup("settings");
@@ -245,6 +430,7 @@ void ofApp::setupGui() {
 	doFullScreen.addListener(this, &ofApp::setFullScreen);
 	gui.add(toggleGuiDraw.set("show gui (G)", false));
 	gui.add(doFlipCamera.set("flip camera", true));
+	gui.add(staleFlowHalfLife.set("stale flow half-life", 0, 0, 5));
 	gui.add(doDrawCamBackground.set("draw camera (C)", true));
 #ifdef _WIN32
 	gui.add(sendToSpout.set("Send to Spout", false));
@@ -258,7 +444,22 @@ void ofApp::setupGui() {
 	gui.add(psEyeCameraIndex.set("PsEye Camera num (x)", 0, 0, 2));
 	gui.add(psEyeRawOpticalFlow.set("psEye raw flow", true));
 	gui.add(useAgc.set("psEye AGC", true));
+	gui.add(psEyeRawBayer.set("psEye raw bayer", false));
+	psEyeRawBayer.addListener(this, &ofApp::onPsEyeRawBayerChanged);
+	gui.add(psEyeMultiCamera.set("psEye stitch all cameras", false));
+	psEyeMultiCamera.addListener(this, &ofApp::onPsEyeMultiCameraChanged);
+	gui.add(psEyeSoftwareAec.set("psEye software AEC", false));
+	psEyeSoftwareAec.addListener(this, &ofApp::onPsEyeSoftwareAecChanged);
+	gui.add(psEyeAecTarget.set("psEye AEC target", 110, 16, 235));
+	psEyeAecTarget.addListener(this, &ofApp::onPsEyeAecTargetChanged);
+	gui.add(psEyeAecSpeed.set("psEye AEC speed", 0.5, 0.05, 1));
+	psEyeAecSpeed.addListener(this, &ofApp::onPsEyeAecSpeedChanged);
 	gui.add(kinectFilterUsers.set("Users-only kinect filter", false));
+	// before the default is set, so the pipeline source gets it even when the settings have none
+	gstPipeline.addListener(this, &ofApp::onGstPipelineChanged);
+#ifdef TARGET_LINUX
+	gui.add(gstPipeline.set("Pipeline", "v4l2src"));
+#endif
     gui.add(showLogo.set("Show logo", false));
 	kinectFilterUsers.addListener(this, &ofApp::onUserOnlyKinectFilter);
 	psEyeCameraIndex.addListener(this, &ofApp::psEyeCameraChanged);
@@ -282,11 +483,80 @@ void ofApp::setupGui() {
 	guiColorSwitch = 1 - guiColorSwitch;
 	gui.add(recolor.parameters);
 
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(psEyeRig.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(sourceManager.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(dualSource.parameters);
+
+	latency.setup();
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(latency.parameters);
+
+	sessionParameters.setName("session");
+	sessionParameters.add(recordSession.set("Record session", false));
+	recordSession.addListener(this, &ofApp::onRecordSessionChanged);
+	sessionParameters.add(sessionFile.set("Replay file", "sessions/replay.vqs"));
+	sessionFile.addListener(this, &ofApp::onSessionFileChanged);
+	sessionParameters.add(sessionStartTime.set("Replay from (sec)", 0, 0, 600));
+	sessionParameters.add(sessionSpeed.set("Replay speed", 1, 0, 4));
+	sessionSpeed.addListener(this, &ofApp::onSessionSpeedChanged);
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(sessionParameters);
+
 	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
 	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
 	guiColorSwitch = 1 - guiColorSwitch;
 	gui.add(velocityMask.parameters);
 
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(backgroundModel.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(depthDenoise.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(cameraRemap.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(frameInterpolator.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(flowCache.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(cameraDenoise.parameters);
+
+	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
+	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
+	guiColorSwitch = 1 - guiColorSwitch;
+	gui.add(presence.parameters);
+
 	gui.setDefaultHeaderBackgroundColor(guiHeaderColor[guiColorSwitch]);
 	gui.setDefaultFillColor(guiFillColor[guiColorSwitch]);
 	guiColorSwitch = 1 - guiColorSwitch;
@@ -341,6 +611,9 @@ void ofApp::setupGui() {
 		gui.saveToFile("settings.xml");
 
 	gui.loadFromFile("settings.xml");
+	// a session never starts recording by itself
+	recordSession.set(false);
+	ofAddListener(static_cast<ofParameterGroup&>(gui.getParameter()).parameterChangedE(), this, &ofApp::onGuiParameterChanged);
 
 	gui.minimizeAll();
 	toggleGuiDraw = false;
@@ -360,25 +633,137 @@ int ofApp::getNumberOfSettingsFile() {
 //}
 
 void ofApp::psEyeCameraChanged(int& index) {
-	if (isPsEyeSource()) {
+	// also when it is only pre-opened
+	if ((isPsEyeSource() || psEyeSource.isOpen()) && !psEyeMultiCamera) {
 		setupPsEye();
 	}
 }
 
-void ofApp::onUserOnlyKinectFilter(bool& isOn) {
+// The output format is chosen in init() so the eye has to be restarted. update() will set it up again
+void ofApp::onPsEyeRawBayerChanged(bool& isOn) {
+	psEyeSource.close();
+}
+
+void ofApp::onPsEyeSoftwareAecChanged(bool& isOn) {
+	ps3eye::PS3EYECam::PS3EYERef eye = psEyeSource.getEye();
+	if (eye) {
+		eye->setSoftwareAutoExposure(isOn);
+		if (!isOn) {
+			eye->setAutogain(useAgc);
+		}
+	}
+}
+
+void ofApp::onPsEyeAecTargetChanged(int& target) {
+	ps3eye::PS3EYECam::PS3EYERef eye = psEyeSource.getEye();
+	if (eye) {
+		eye->setAutoExposureTarget(target);
+	}
+}
+
+void ofApp::onPsEyeAecSpeedChanged(float& speed) {
+	ps3eye::PS3EYECam::PS3EYERef eye = psEyeSource.getEye();
+	if (eye) {
+		eye->setAutoExposureSpeed(speed);
+	}
+}
+
+// The source manager opens it again with the new description if it is needed
+void ofApp::onGstPipelineChanged(string& description) {
+#ifdef TARGET_LINUX
+	pipelineSource.close();
+	pipelineSource.setup(description);
+#endif
+}
+
+void ofApp::onRecordSessionChanged(bool& isOn) {
 	if (isOn) {
-		//Only if there is a person set it on otherwise turn it back off
-		/*if (ofApp::getNumberOfTrackedBodies() <= 0) {
-			ofLogWarning("No person found in frame. turning off");
-			kinectFilterUsers.set(false);
+		ofDirectory::createDirectory("sessions", true, true);
+		recordSession.setWithoutEventNotifications(sessionRecorder.start("sessions/session-" + ofGetTimestampString("%Y%m%d-%H%M%S") + ".vqs"));
+	}
+	else {
+		sessionRecorder.stop();
+	}
+}
+
+// The source manager opens the new file if the session is replayed
+void ofApp::onSessionFileChanged(string& path) {
+	sessionSource.close();
+}
+
+void ofApp::onSessionSpeedChanged(float& speed) {
+	sessionSource.setSpeed(speed);
+}
+
+// Every gui parameter change goes into the recording, by its path in the gui
+void ofApp::onGuiParameterChanged(ofAbstractParameter& parameter) {
+	if (!sessionRecorder.isRecording() || !parameter.isSerializable() || parameter.getName() == recordSession.getName()) {
+		return;
+	}
+	vector<string> names = parameter.getGroupHierarchyNames();
+	string path;
+	for (size_t i = 0; i < names.size(); i++) {
+		path += (i ? ":" : "") + names[i];
+	}
+	sessionRecorder.writeParameter(ofxFrameSource::now(), path, parameter.toString());
+}
+
+// The events recorded up to the replayed frame, in recorded order
+void ofApp::applySessionEvents() {
+	for (const ofxOscMessage& message : sessionSource.getOscMessages()) {
+		ofxOscMessage m = message;
+		handleOscMessage(m);
+	}
+	for (const ofxSessionSource::ParameterChange& change : sessionSource.getParameterChanges()) {
+		applyParameterChange(change.path, change.value);
+	}
+	// recorded source switches don't apply, the replay is the source
+	if (sourceMode != SOURCE_SESSION) {
+		sourceMode = SOURCE_SESSION;
+	}
+}
+
+void ofApp::applyParameterChange(const string& path, const string& value) {
+	vector<string> names = tokenize(path, ":");
+	// the first name is the gui itself
+	if (names.size() < 2) {
+		return;
+	}
+	ofParameterGroup* group = &static_cast<ofParameterGroup&>(gui.getParameter());
+	for (size_t i = 1; i + 1 < names.size(); i++) {
+		if (!group->contains(names[i])) {
 			return;
-		}*/
+		}
+		group = &group->getGroup(names[i]);
+	}
+	if (!group->contains(names.back())) {
+		return;
+	}
+	ofAbstractParameter& parameter = group->get(names.back());
+	if (parameter.getName() == sourceMode.getName() || parameter.getName() == recordSession.getName() || parameter.getName() == sessionFile.getName()) {
+		return;
+	}
+	parameter.fromString(value);
+}
+
+void ofApp::onPsEyeMultiCameraChanged(bool& isOn) {
+	// update() opens whichever is needed
+	if (isOn) {
+		psEyeSource.close();
+	}
+	else {
+		psEyeRig.close();
+	}
+}
+
+void ofApp::onUserOnlyKinectFilter(bool& isOn) {
+	if (isOn) {
 		//reset last time a person was in frame
-		timeSinceLastTimeAPersonWasInFrame = ofGetElapsedTimef();
+		timeSinceLastTimeAPersonWasInFrame = clock.getElapsedTimef();
 	}
 	else {
 		//reset last time a person was not in frame
-		timeSinceLastTimeAPersonWasInFrame = ofGetElapsedTimef() -TIMEOUT_KINECT_PEOPLE_FILTER; 
+		timeSinceLastTimeAPersonWasInFrame = clock.getElapsedTimef() -TIMEOUT_KINECT_PEOPLE_FILTER; 
 	}
 }
 
@@ -413,114 +798,209 @@ bool ofApp::isVideoSource() {
 	return (sourceMode.get() == SOURCE_VIDEO);
 }
 
-//--------------------------------------------------------------
-void ofApp::update() {
-
-	deltaTime = ofGetElapsedTimef() - lastTime;
-	lastTime = ofGetElapsedTimef();
-	simpleCam.update();
-#ifdef _KINECT
-	if (isKinectSource()) {
-		kinect.update(); 
-	}
-#endif
-
-	if(isPsEyeSource()) {
-		if (!eye) {
-			setupPsEye();
-		}
-	}
+bool ofApp::isSessionSource() {
+	return (sourceMode.get() == SOURCE_SESSION);
+}
 
-	if (isVideoSource()) {
-		if (!videoPlayer.isInitialized()) {
-			setupVideoSource();
-		}
-	}
+bool ofApp::isKinectAndPsEyeSource() {
+	return (sourceMode.get() == SOURCE_KINECT_PSEYE);
+}
 
-	if (isPsEyeSource() && eye)
-	{
-		try {
-			uint8_t* new_pixels = eye->getFrame();
-			yuv422_to_rgba(new_pixels, eye->getRowBytes(), videoFrame, eye->getWidth(), eye->getHeight());
-			videoTexture.loadData(videoFrame, eye->getWidth(), eye->getHeight(), GL_RGBA);
-			free(new_pixels);
-		}
-		catch (...) {
-			ofLogWarning("Can't open ps eye. exception. moving to kinect");
-			sourceMode.set((sourceMode.get() + 1) % SOURCE_COUNT);
-		}
+// The input through its denoise stage if that is on
+ofTexture& ofApp::denoise(ftTemporalDenoise& stage, ofTexture& source) {
+	if (!stage.isEnabled()) {
+		// a new history when it is used again
+		stage.reset();
+		return source;
 	}
+	return stage.update(source);
+}
 
-	if (isVideoSource()) {
-		videoPlayer.update();
+ofTexture& ofApp::filterDepthUsers(ofTexture& depth, ofTexture& bodyIndex, int bodyCount) {
+	if (kinectFilterUsers.get()) {
+		drawMaskedShader.update(kinectFbo, depth, bodyIndex, bodyCount);
+		return kinectFbo.getTexture();
 	}
+	return depth;
+}
 
+//--------------------------------------------------------------
+void ofApp::update() {
 
-#ifdef _KINECT
-	if ((isKinectSource() && (kinect.getDepthSource()->isFrameNew())) ||
-		(isPsEyeSource() && eye) || (isVideoSource() && videoPlayer.isFrameNew() )) {
-#else
-	if ((isPsEyeSource() && eye) || simpleCam.isFrameNew() || (isVideoSource() && videoPlayer.isFrameNew())) {
-#endif
+	clock.update();
+	deltaTime = clock.getDeltaTime();
+	// after the last frame's buffer swap
+	latency.update();
 
-		ofTexture *videoSource;
+	// an offline render keeps to its input
+	if (!sourceManager.update(sourceMode, offlineRender.isEnabled() ? sourceMode.get() : predictNextSourceMode())) {
+		if (offlineRender.isEnabled()) {
+			ofLogError() << "Can't open " << offlineRender.getSettings().input << " to render";
+			ofExit(1);
+			return;
+		}
+		ofLogWarning() << "Can't open " << getActiveSource().getName() << ". moving to the next source";
+		sourceMode.set(getNextSourceMode());
+	}
+
+	// the sources capture and convert on their own threads, this only picks up the newest frame if there is one
+	getActiveSource().update();
+	if (isSessionSource()) {
+		applySessionEvents();
+	}
+	// the camera passes only run on frames they haven't seen, the simulation keeps going on the last flow
+	bool isNewFrame = isUnprocessedFrame();
+	ofTexture* presenceMask = NULL;
+	bool isInterpolatedFrame = false;
+	if (isNewFrame) {
+		if (processedSource != &getActiveSource()) {
+			cameraRemap.load("calibration/" + getActiveSource().getName() + ".xml");
+			backgroundModel.reset();
+			depthDenoise.reset();
+			cameraDenoise.reset();
+			frameInterpolator.reset();
+		}
+		processedSource = &getActiveSource();
+		processedSequence = processedSource->getFrameSequence();
+		processedTime = clock.getElapsedTimef();
+		latency.beginFrame(getActiveSource().getFrameTime());
+		sourceManager.record(getActiveSource());
+
+		ofTexture *sourceTexture;
+		hasBodyIndex = false;
 		switch (sourceMode) {
-#ifdef _KINECT
 		case SOURCE_KINECT:
-		{
-			checkIfPersonIdentified();
-
-			int tracked = kinect.getBodySource()->getBodyCount();
-			if (kinectFilterUsers.get()) {
-				drawMaskedShader.update(kinectFbo, kinect.getDepthSource()->getTexture(), kinect.getBodyIndexSource()->getTexture(), tracked);
-				videoSource = &kinectFbo.getTexture();
+			if (!hasKinect()) {
+				sourceTexture = &getActiveSource().getTexture();
+				break;
+			}
+			sourceTexture = &filterDepthUsers(denoise(depthDenoise, kinectSource.getTexture()), kinectSource.getBodyIndexTexture(), kinectSource.getBodyCount());
+			presenceMask = &kinectSource.getBodyIndexTexture();
+			hasBodyIndex = true;
+			break;
+		case SOURCE_SESSION:
+			if (sessionSource.isDepthFrame()) {
+				sourceTexture = &filterDepthUsers(denoise(depthDenoise, sessionSource.getTexture()), sessionSource.getBodyIndexTexture(), sessionSource.getBodyCount());
+				presenceMask = &sessionSource.getBodyIndexTexture();
+				hasBodyIndex = true;
 			}
 			else {
-				videoSource = &kinect.getDepthSource()->getTexture();
+				sourceTexture = &sessionSource.getTexture();
 			}
-		}
-			break;
-#endif
-		case SOURCE_PS3EYE:
-			videoSource = &videoTexture;
-			break;
-		case SOURCE_VIDEO:
-			videoSource = &videoPlayer.getTexture();
 			break;
 		default:
-			videoSource = &simpleCam.getTexture();
+			sourceTexture = &getActiveSource().getTexture();
 			break;
 		}
+		if (!hasBodyIndex) {
+			sourceTexture = &denoise(cameraDenoise, *sourceTexture);
+		}
+		// depth has the body index for this. The model also learns for the presence detection alone
+		if (!hasBodyIndex && (backgroundModel.isEnabled() || presence.enabled)) {
+			backgroundModel.learn(*sourceTexture);
+			presenceMask = &backgroundModel.getMask();
+			if (backgroundModel.isEnabled()) {
+				sourceTexture = &backgroundModel.apply(*sourceTexture);
+			}
+		}
+		else {
+			// a new model when it is used again
+			backgroundModel.reset();
+		}
 
 		ofPushStyle();
 		ofEnableBlendMode(OF_BLENDMODE_DISABLED);
 
-		recolor.update(cameraFbo, *videoSource, doFlipCamera);
+		recolor.setTime(clock.getElapsedTimef());
+		recolor.setRemap(cameraRemap.update(doFlipCamera));
+		recolor.update(cameraFbo, *sourceTexture, doFlipCamera);
+		cameraPyramid.update(cameraFbo.getTexture());
+		latency.mark(ofxLatencyMonitor::STAGE_RECOLOR);
 
 		ofPopStyle();
 		// TODO: figure out how to use kinectFbo for this on kinect and to have it work
-		if ((sourceMode == SOURCE_PS3EYE) && (psEyeRawOpticalFlow.get())) {
-			opticalFlow.setSource(videoTexture);
+		if ((sourceMode == SOURCE_PS3EYE || isKinectAndPsEyeSource()) && (psEyeRawOpticalFlow.get())) {
+			flowInput = sourceTexture;
 		}
 		else {
-			opticalFlow.setSource(cameraFbo.getTexture());
+			flowInput = &cameraPyramid.getLevel(flowWidth, flowHeight);
+		}
+		// the flow keeps its previous frame even when this one comes from the cache
+		opticalFlow.setSource(*flowInput);
+
+		bool isCachedVideo = sourceMode == SOURCE_VIDEO && flowCache.enabled;
+		if (isCachedVideo) {
+			// the settings of everything between the clip and the flow, recolor included (the flow runs on
+			// cameraFbo). Recolor animation isn't part of it
+			string flowSettings = ofToString(doFlipCamera.get()) + ofToString(cameraRemap.isCalibrated() && cameraRemap.enabled) +
+				ofToString(flowWidth) + "x" + ofToString(flowHeight) + opticalFlow.parameters.toString() +
+				getSettingsKey(cameraDenoise.parameters, cameraDenoise.enabled) +
+				getSettingsKey(backgroundModel.parameters, backgroundModel.enabled) +
+				getSettingsKey(recolor.parameters, recolor.active);
+			flowCache.setClip(videoSource.getClipPath(), videoSource.getClipFrameCount(), flowSettings);
+		}
+		isFlowFromCache = isCachedVideo && flowCache.load(videoSource.getClipFrame());
+		if (!isFlowFromCache) {
+			//opticalFlow.update(deltaTime);
+			// use internal deltatime instead
+			opticalFlow.update();
+			// with interpolated ticks in between the flow only covers the time since the last tick
+			if (isCachedVideo && !frameInterpolator.enabled) {
+				flowCache.store(videoSource.getClipFrame(), opticalFlow.getOpticalFlow(), opticalFlow.getOpticalFlowDecay());
+			}
+		}
+		latency.mark(ofxLatencyMonitor::STAGE_OPTICAL_FLOW);
+		if (frameInterpolator.enabled) {
+			if (isFlowFromCache) {
+				frameInterpolator.clearTicks();
+			}
+			frameInterpolator.addFrame(getOpticalFlow(), clock.getElapsedTimef());
+		}
+		else {
+			frameInterpolator.reset();
 		}
 
-		//opticalFlow.update(deltaTime);
-		// use internal deltatime instead
-		opticalFlow.update();
 
+		velocityMask.setDensity(cameraPyramid.getLevel(maskWidth, maskHeight));
+		velocityMask.setVelocity(getOpticalFlow());
+		velocityMask.update();
+	}
+	else if (frameInterpolator.isReady()) {
+		// between camera frames the last one moves on along its flow, so the flow and the mask change at display rate
+		ofTexture& maskInput = cameraPyramid.getLevel(maskWidth, maskHeight);
+		if (interpolatedMaskInputFbo.getWidth() != maskInput.getWidth() || interpolatedMaskInputFbo.getHeight() != maskInput.getHeight()) {
+			interpolatedMaskInputFbo.allocate(maskInput.getWidth(), maskInput.getHeight());
+		}
+		ofTexture& frame = frameInterpolator.update(interpolatedMaskInputFbo, maskInput, clock.getElapsedTimef());
+		if (interpolatedFlowInputFbo.getWidth() != flowInput->getWidth() || interpolatedFlowInputFbo.getHeight() != flowInput->getHeight()) {
+			interpolatedFlowInputFbo.allocate(flowInput->getWidth(), flowInput->getHeight());
+		}
+		opticalFlow.setSource(frameInterpolator.update(interpolatedFlowInputFbo, *flowInput, clock.getElapsedTimef()));
+		opticalFlow.update();
+		isFlowFromCache = false;
+		frameInterpolator.addTick(opticalFlow.getOpticalFlow());
 
-		velocityMask.setDensity(cameraFbo.getTexture());
+		velocityMask.setDensity(frame);
 		velocityMask.setVelocity(opticalFlow.getOpticalFlow());
 		velocityMask.update();
+		isInterpolatedFrame = true;
+	}
+
+
+	float flowStrength = 1;
+	if (!isNewFrame && !isInterpolatedFrame && staleFlowHalfLife > 0) {
+		flowStrength = pow(0.5f, (clock.getElapsedTimef() - processedTime) / staleFlowHalfLife);
 	}
 
+	// samples now and then, the results come in frames later
+	presence.update(presenceMask, hasBodyIndex, clock.getElapsedTimef());
+	checkIfPersonIdentified();
+	flowCache.update();
 
-	fluidSimulation.addVelocity(opticalFlow.getOpticalFlowDecay());  //!
+	fluidSimulation.addVelocity(getOpticalFlowDecay(), flowStrength);  //!
 																	 //fluidSimulation.addVelocity(cameraFbo.getTexture()); //!
-	fluidSimulation.addDensity(velocityMask.getColorMask());
-	fluidSimulation.addTemperature(velocityMask.getLuminanceMask());
+	fluidSimulation.addDensity(velocityMask.getColorMask(), flowStrength);
+	fluidSimulation.addTemperature(velocityMask.getLuminanceMask(), flowStrength);
 
 	mouseForces.update(deltaTime);
 
@@ -548,17 +1028,20 @@ void ofApp::update() {
 		}
 	}
 
-	fluidSimulation.update();
+	// 0 lets flowtools time the steps itself
+	float simulationStep = clock.isFixedStep() ? deltaTime : 0;
+	fluidSimulation.update(simulationStep);
 
 	if (particleFlow.isActive()) {
 		particleFlow.setSpeed(fluidSimulation.getSpeed());
 		particleFlow.setCellSize(fluidSimulation.getCellSize());
-		particleFlow.addFlowVelocity(opticalFlow.getOpticalFlow());
+		particleFlow.addFlowVelocity(getOpticalFlow(), flowStrength);
 		particleFlow.addFluidVelocity(fluidSimulation.getVelocity());
 		//		particleFlow.addDensity(fluidSimulation.getDensity());
 		particleFlow.setObstacle(fluidSimulation.getObstacle());
 	}
-	particleFlow.update();
+	particleFlow.update(simulationStep);
+	latency.mark(ofxLatencyMonitor::STAGE_FLUID);
 	
 	updateTransition();
 
@@ -567,49 +1050,47 @@ void ofApp::update() {
 	updateJumpBetweenStates();
 }
 
-void ofApp::checkIfPersonIdentified() {
-	//Update time of last person identified
-	//Sample every 4 seconds -> TODO now sample from 4.0 4.1 and so on till 5.0 need to sample only once
-	if ((int)ofGetElapsedTimef() % 4 == 0) {
-		int realTrackedPerson = getNumberOfTrackedBodies();
+// True if the active source holds a frame the pipeline hasn't processed yet, also right after switching
+// back to a source that still holds the frame it had before. Sequence numbers start at 1 per source
+bool ofApp::isUnprocessedFrame() {
+	ofxFrameSource& source = getActiveSource();
+	if (!source.getFrameSequence())
+		return false;
+	return &source != processedSource || source.getFrameSequence() != processedSequence;
+}
 
-		if (realTrackedPerson > 0) {
-			timeSinceLastTimeAPersonWasInFrame = ofGetElapsedTimef();
-		}
+void ofApp::checkIfPersonIdentified() {
+	//Update time of last person identified. The presence detector has its own hysteresis, for every source
+	if (!presence.enabled) {
+		return;
+	}
+	if (presence.isPresent()) {
+		timeSinceLastTimeAPersonWasInFrame = clock.getElapsedTimef();
 	}
 
-	float delta = ofGetElapsedTimef() - timeSinceLastTimeAPersonWasInFrame;
+	float delta = clock.getElapsedTimef() - timeSinceLastTimeAPersonWasInFrame;
+	// the users-only filter for depth, the background model for the cameras
+	ofParameter<bool>& peopleOnly = hasBodyIndex ? kinectFilterUsers : backgroundModel.enabled;
 
 	//Only on auto pilot (doJumpBetweenStates) we set those modes
-	if (delta >= TIMEOUT_KINECT_PEOPLE_FILTER && kinectFilterUsers.get() && doJumpBetweenStates) {
+	if (delta >= TIMEOUT_KINECT_PEOPLE_FILTER && peopleOnly.get() && doJumpBetweenStates) {
 		ofLogWarning("No person found. moving to background mode. (Check if auto pilot is on)");
-		kinectFilterUsers.set(false);
+		peopleOnly.set(false);
 		return;
 	}
 
 	//Only on auto pilot (doJumpBetweenStates) we set those modes
-	if (delta < TIMEIN_KINECT_PEOPLE_FILTER && !kinectFilterUsers.get() && doJumpBetweenStates) {
+	if (delta < TIMEIN_KINECT_PEOPLE_FILTER && !peopleOnly.get() && doJumpBetweenStates) {
 		ofLogWarning("Person found. Removing background. (Check if auto pilot is on)");
-		kinectFilterUsers.set(true);
+		peopleOnly.set(true);
 	}
 }
 
-int ofApp::getNumberOfTrackedBodies() {
-	int result = 0;
-#ifdef KINECT
-	const vector<ofxKinectForWindows2::Data::Body> bodies = kinect.getBodySource()->getBodies();
-	for (int i = 0; i < bodies.size(); i++) {
-		result += (bodies[i].tracked ? 1 : 0);
-	}
-#endif
-	return result;
-}
-
 void ofApp::updateJumpBetweenStates() {
 	if (!doJumpBetweenStates || jumpBetweenStatesInterval <= 0) {
 		return;
 	}
-	float timeSinceAnimationStart = ofGetElapsedTimef() - transitionStartTime;
+	float timeSinceAnimationStart = clock.getElapsedTimef() - transitionStartTime;
 	// Check if animation completed
 	if (timeSinceAnimationStart >= jumpBetweenStatesInterval) {
 		jumpToNextEffect();
@@ -620,248 +1101,285 @@ void ofApp::updateJumpBetweenStates() {
 }
 
 void ofApp::updateOscMessages() {
+	if (offlineRender.isEnabled()) {
+		return;
+	}
 	while (oscReceiver.hasWaitingMessages()) {
 		ofxOscMessage m;
 		oscReceiver.getNextMessage(&m);
+		sessionRecorder.writeOsc(ofxFrameSource::now(), m);
+		handleOscMessage(m);
+	}
+    
+//    Activate auto pilot to on if no message was received for a given period (30 seconds) and no auto pilot is set yet
+//    float timeSinceLastMessage = clock.getElapsedTimef() - lastOscMessageTime;
+//    if(timeSinceLastMessage >= AUTO_PILOT_TIMEOUT && doJumpBetweenStates.get() != 1) {
+//        lastOscMessageTime = clock.getElapsedTimef();
+//        doJumpBetweenStates.set(1);
+//        ofLogWarning("No osc message received for the last 15 seconds. moving to auto pilot");
+//    }
+}
+
+// Also gets the messages of a replayed session
+void ofApp::handleOscMessage(ofxOscMessage& m) {
+	ps3eye::PS3EYECam::PS3EYERef eye = psEyeSource.getEye();
+
+    lastOscMessageTime = clock.getElapsedTimef();
+	// Set remote address by osc message
+	if (!m.getRemoteIp().empty() && oscRemoteServerIpAddress.empty()) {
+		oscRemoteServerIpAddress = m.getRemoteIp();
+		//oscSender.setup(oscRemoteServerIpAddress, PORT_SERVER);
+	}
 		
-        lastOscMessageTime = ofGetElapsedTimef();
-		// Set remote address by osc message
-		if (!m.getRemoteIp().empty() && oscRemoteServerIpAddress.empty()) {
-			oscRemoteServerIpAddress = m.getRemoteIp();
-			//oscSender.setup(oscRemoteServerIpAddress, PORT_SERVER);
-		}
-			
-		if (m.getAddress() == "/1/strength") {
-			opticalFlow.setStrength(m.getArgAsFloat(0));
-		}
-		if (m.getAddress() == "/1/speed") {
-			fluidSimulation.setSpeed(m.getArgAsFloat(0));
-		}
+	if (m.getAddress() == "/1/strength") {
+		opticalFlow.setStrength(m.getArgAsFloat(0));
+	}
+	if (m.getAddress() == "/1/speed") {
+		fluidSimulation.setSpeed(m.getArgAsFloat(0));
+	}
 
-		if (m.getAddress() == "/1/cutoff") {
-			recolor.cutoff.set(m.getArgAsFloat(0));
-		}
+	if (m.getAddress() == "/1/cutoff") {
+		recolor.cutoff.set(m.getArgAsFloat(0));
+	}
 
-		if (m.getAddress() == "/1/draw_camera" &&
-			m.getArgAsBool(0) == true) {
-			doDrawCamBackground.set(!doDrawCamBackground.get());
-		}
+	if (m.getAddress() == "/1/draw_camera" &&
+		m.getArgAsBool(0) == true) {
+		doDrawCamBackground.set(!doDrawCamBackground.get());
+	}
 
-		if (m.getAddress() == "/1/stretch" &&
-			m.getArgAsBool(0) == true) {
-			particleFlow.bStretch.set(!particleFlow.bStretch);
-		}
+	if (m.getAddress() == "/1/stretch" &&
+		m.getArgAsBool(0) == true) {
+		particleFlow.bStretch.set(!particleFlow.bStretch);
+	}
 
-		if (m.getAddress() == "/1/spawn_hue") {
-			particleFlow.spawnHue.set(m.getArgAsFloat(0));
-		}
+	if (m.getAddress() == "/1/spawn_hue") {
+		particleFlow.spawnHue.set(m.getArgAsFloat(0));
+	}
 
-		if (m.getAddress() == "/1/over_color") {
-			velocityMask.hueOffset.set(m.getArgAsFloat(0));
-		}
+	if (m.getAddress() == "/1/over_color") {
+		velocityMask.hueOffset.set(m.getArgAsFloat(0));
+	}
 
-		if (m.getAddress() == "/1/particle_size") {
-			particleFlow.size.set(m.getArgAsFloat(0));
-		}
+	if (m.getAddress() == "/1/particle_size") {
+		particleFlow.size.set(m.getArgAsFloat(0));
+	}
 
-		if (m.getAddress() == "/1/reset" &&
-			m.getArgAsBool(0) == true) {
-			reset();
+	if (m.getAddress() == "/1/reset" &&
+		m.getArgAsBool(0) == true) {
+		reset();
+	}
+
+	if (m.getAddress() == "/1/source" &&
+		m.getArgAsBool(0) == true) {
+		if (sourceMode != SOURCE_KINECT) {
+			sourceMode = SOURCE_KINECT;
 		}
+	}
 
-		if (m.getAddress() == "/1/source" &&
-			m.getArgAsBool(0) == true) {
-			if (sourceMode != SOURCE_KINECT) {
-				sourceMode = SOURCE_KINECT;
-			}
+	if ((m.getAddress().find("/1/effects") != std::string::npos) &&
+		(m.getArgAsBool(0) == true)) {
+		int mode = stoi(m.getAddress().substr(m.getAddress().find("1", 2) + 2)); //find the next /1
+		switch (mode) {
+			case 0: drawMode.set(DRAW_COMPOSITE); break;
+			case 1: drawMode.set(DRAW_COMPOSITE); break;
+			case 2: drawMode.set(DRAW_FLUID_DENSITY); break;
+			case 3: drawMode.set(DRAW_PARTICLES); break;
+			case 4: drawMode.set(DRAW_DISPLACEMENT); break;
 		}
+	}
+    
+    if (m.getAddress() == "/1/animate_scale") {
+        recolor.animateScale.set(m.getArgAsBool(0));
+		recolor.animateOffset.set(m.getArgAsBool(0));
+    }
 
-		if ((m.getAddress().find("/1/effects") != std::string::npos) &&
-			(m.getArgAsBool(0) == true)) {
-			int mode = stoi(m.getAddress().substr(m.getAddress().find("1", 2) + 2)); //find the next /1
-			switch (mode) {
-				case 0: drawMode.set(DRAW_COMPOSITE); break;
-				case 1: drawMode.set(DRAW_COMPOSITE); break;
-				case 2: drawMode.set(DRAW_FLUID_DENSITY); break;
-				case 3: drawMode.set(DRAW_PARTICLES); break;
-				case 4: drawMode.set(DRAW_DISPLACEMENT); break;
-			}
+	if (m.getAddress() == "/1/gravity_y") {
+		ofVec2f gravity = fluidSimulation.getGravity();
+		fluidSimulation.setGravity(ofVec2f(gravity.x, m.getArgAsFloat(0)));
+	}
+
+	if (m.getAddress() == "/1/dissipation") {
+		fluidSimulation.setDissipation(m.getArgAsFloat(0));
+	}
+
+	if (m.getAddress() == "/1/next_effect" &&
+		m.getArgAsBool(0) == true) {
+		jumpToNextEffect();
+	}
+
+	if (m.getAddress() == "/1/ir_jump" &&
+		m.getArgAsBool(0) == true) {
+		if (sourceMode != SOURCE_PS3EYE) {
+			sourceMode = SOURCE_PS3EYE;
 		}
-        
-        if (m.getAddress() == "/1/animate_scale") {
-            recolor.animateScale.set(m.getArgAsBool(0));
-			recolor.animateOffset.set(m.getArgAsBool(0));
-        }
-
-		if (m.getAddress() == "/1/gravity_y") {
-			ofVec2f gravity = fluidSimulation.getGravity();
-			fluidSimulation.setGravity(ofVec2f(gravity.x, m.getArgAsFloat(0)));
+		else {
+			psEyeCameraIndex.set((psEyeCameraIndex.get() + 1) % (psEyeCameraIndex.getMax() + 1));
 		}
+	}
 
-		if (m.getAddress() == "/1/dissipation") {
-			fluidSimulation.setDissipation(m.getArgAsFloat(0));
+	// A manual exposure/gain takes over from the software auto exposure
+	if (m.getAddress() == "/1/ir_exposure") {
+		psEyeSoftwareAec.set(false);
+		if (eye) {
+			eye->setExposure(m.getArgAsFloat(0));
 		}
+	}
 
-		if (m.getAddress() == "/1/next_effect" &&
-			m.getArgAsBool(0) == true) {
-			jumpToNextEffect();
+	if (m.getAddress() == "/1/ir_gain") {
+		psEyeSoftwareAec.set(false);
+		if (eye) {
+			eye->setGain(m.getArgAsFloat(0));
 		}
+	}
 
-		if (m.getAddress() == "/1/ir_jump" &&
-			m.getArgAsBool(0) == true) {
-			if (sourceMode != SOURCE_PS3EYE) {
-				sourceMode = SOURCE_PS3EYE;
-			}
-			else {
-				psEyeCameraIndex.set((psEyeCameraIndex.get() + 1) % (psEyeCameraIndex.getMax() + 1));
-			}
-		}
+	if (m.getAddress() == "/1/ir_aec_target") {
+		psEyeAecTarget.set(m.getArgAsFloat(0));
+	}
 
-		if (m.getAddress() == "/1/ir_exposure") {
-			if (eye) {
-				eye->setExposure(m.getArgAsFloat(0));
-			}
+	if (m.getAddress() == "/1/ir_hue") {
+		if (eye) {
+			eye->setHue(m.getArgAsFloat(0));
 		}
+	}
 
-		if (m.getAddress() == "/1/ir_gain") {
-			if (eye) {
-				eye->setGain(m.getArgAsFloat(0));
-			}
-		}
+	if (m.getAddress() == "/settings/measure_latency") {
+		latency.enabled.set(m.getArgAsBool(0));
+	}
 
-		if (m.getAddress() == "/1/ir_hue") {
-			if (eye) {
-				eye->setHue(m.getArgAsFloat(0));
-			}
-		}
+	if (m.getAddress() == "/settings/record_session") {
+		recordSession.set(m.getArgAsBool(0));
+	}
 
-		if (m.getAddress() == "/1/kinect_filter_users") {
-			kinectFilterUsers.set(m.getArgAsBool(0));
-		}
+	if (m.getAddress() == "/settings/gst_pipeline") {
+		gstPipeline.set(m.getArgAsString(0));
+	}
 
-		if (m.getAddress() == "/1/ps_eye_raw_optical_flow") {
-			psEyeRawOpticalFlow.set(m.getArgAsBool(0));
-		}
+	if (m.getAddress() == "/1/kinect_filter_users") {
+		kinectFilterUsers.set(m.getArgAsBool(0));
+	}
 
-		if (m.getAddress() == "/1/draw") {
-			float y = m.getArgAsFloat(0);
-			float x = m.getArgAsFloat(1);
-			ofApp::setMousePosition(x, y);
-		}
+	if (m.getAddress() == "/1/ps_eye_raw_optical_flow") {
+		psEyeRawOpticalFlow.set(m.getArgAsBool(0));
+	}
 
-		if (m.getAddress() == "/1/toggle_draw") {
-			bool isOn = m.getArgAsBool(0);
-			if (isOn) {
-				ofxMouse::MouseEvent(ofxMouse::LeftDown);
-			}
-			else {
-				ofxMouse::MouseEvent(ofxMouse::LeftUp);
-			}
-		}
+	if (m.getAddress() == "/1/draw") {
+		float y = m.getArgAsFloat(0);
+		float x = m.getArgAsFloat(1);
+		ofApp::setMousePosition(x, y);
+	}
 
-		if (m.getAddress() == "/1/toggle_sticky") {
-			bool isOn = m.getArgAsBool(0);
-			if (isOn) {
-				ofxMouse::MouseEvent(ofxMouse::RightDown);
-			}
-			else {
-				ofxMouse::MouseEvent(ofxMouse::RightUp);
-			}
+	if (m.getAddress() == "/1/toggle_draw") {
+		bool isOn = m.getArgAsBool(0);
+		if (isOn) {
+			ofxMouse::MouseEvent(ofxMouse::LeftDown);
 		}
-        
-        if (m.getAddress() == "/1/next_pattern" &&
-            m.getArgAsBool(0) == true) {
-            jumpToNextPattern();
-        }
-        
-        if (m.getAddress() == "/1/animate_pattern") {
-            recolor.animateTextures.set(m.getArgAsBool(0));
-        }
-
-
-		if (m.getAddress() == "/settings/transition_time" &&
-            m.getArgAsBool(0) == true) {
-			transitionTime.set(m.getArgAsFloat(0));
+		else {
+			ofxMouse::MouseEvent(ofxMouse::LeftUp);
 		}
+	}
 
-		if (m.getAddress() == "/settings/jump_between_states_min") {
-            int seconds = ((int)jumpBetweenStatesInterval.get() % 60);
-            float totalTime = (m.getArgAsInt(0) * 60) + seconds;
-			jumpBetweenStatesInterval.set(totalTime);
-			
-			//TODO: check why after 2 minutes its Crashing the system
-			//float now = ofGetElapsedTimef();
-			//if (timeSinceLastOscMessage < now - 2) { //2 seconds thrashold between message
-			//	sendOscMessage("/settings/animation_time", m.getArgAsFloat(0));
-			//	timeSinceLastOscMessage = now;
-			//}
+	if (m.getAddress() == "/1/toggle_sticky") {
+		bool isOn = m.getArgAsBool(0);
+		if (isOn) {
+			ofxMouse::MouseEvent(ofxMouse::RightDown);
 		}
-        
-        if (m.getAddress() == "/settings/jump_between_states_sec") {
-            int minutes = floor(jumpBetweenStatesInterval / 60);
-            float totalTime = (minutes * 60) + m.getArgAsInt(0);
-            jumpBetweenStatesInterval.set(totalTime);
-        }
-
-		if (m.getAddress() == "/settings/animate") {
-			doJumpBetweenStates.set(m.getArgAsBool(0));
+		else {
+			ofxMouse::MouseEvent(ofxMouse::RightUp);
 		}
+	}
+    
+    if (m.getAddress() == "/1/next_pattern" &&
+        m.getArgAsBool(0) == true) {
+        jumpToNextPattern();
+    }
+    
+    if (m.getAddress() == "/1/animate_pattern") {
+        recolor.animateTextures.set(m.getArgAsBool(0));
+    }
 
-		if ((m.getAddress().find("/settings/jump_to_setting") != std::string::npos) &&
-			m.getArgAsBool(0) == true) {
-
-			int startOfRow = m.getAddress().find("jump_to_setting") + std::string("jump_to_setting/").length();
-			int row = stoi(m.getAddress().substr(startOfRow,1));
-			//int startOfCol = m.getAddress().find("/", startOfRow);
-			int col = stoi(m.getAddress().substr(m.getAddress().find("/", startOfRow)+1));
-			int oldSettingsFileIndex = loadSettingsFileIndex;
-			//Map the matrix of rows and cols to file number
-			loadSettingsFileIndex = ((row-1) * 6) + col; //6 is length of line
-			//TODO: DRY
-			//Transition from current setting to the next one
-			startTransition(relateiveDataPath + "settings" + std::to_string(oldSettingsFileIndex) + ".xml",
-				relateiveDataPath + "settings" + std::to_string(loadSettingsFileIndex) + ".xml");
-		}
 
-		if (m.getAddress() == "/settings/flip_ir_camera" &&
-			m.getArgAsBool(0) == true) {
-			if (isPsEyeSource()) {
-				doFlipCamera = !doFlipCamera;
-			}
+	if (m.getAddress() == "/settings/transition_time" &&
+        m.getArgAsBool(0) == true) {
+		transitionTime.set(m.getArgAsFloat(0));
+	}
+
+	if (m.getAddress() == "/settings/jump_between_states_min") {
+        int seconds = ((int)jumpBetweenStatesInterval.get() % 60);
+        float totalTime = (m.getArgAsInt(0) * 60) + seconds;
+		jumpBetweenStatesInterval.set(totalTime);
+		
+		//TODO: check why after 2 minutes its Crashing the system
+		//float now = clock.getElapsedTimef();
+		//if (timeSinceLastOscMessage < now - 2) { //2 seconds thrashold between message
+		//	sendOscMessage("/settings/animation_time", m.getArgAsFloat(0));
+		//	timeSinceLastOscMessage = now;
+		//}
+	}
+    
+    if (m.getAddress() == "/settings/jump_between_states_sec") {
+        int minutes = floor(jumpBetweenStatesInterval / 60);
+        float totalTime = (minutes * 60) + m.getArgAsInt(0);
+        jumpBetweenStatesInterval.set(totalTime);
+    }
+
+	if (m.getAddress() == "/settings/animate") {
+		doJumpBetweenStates.set(m.getArgAsBool(0));
+	}
+
+	if ((m.getAddress().find("/settings/jump_to_setting") != std::string::npos) &&
+		m.getArgAsBool(0) == true) {
+
+		int startOfRow = m.getAddress().find("jump_to_setting") + std::string("jump_to_setting/").length();
+		int row = stoi(m.getAddress().substr(startOfRow,1));
+		//int startOfCol = m.getAddress().find("/", startOfRow);
+		int col = stoi(m.getAddress().substr(m.getAddress().find("/", startOfRow)+1));
+		int oldSettingsFileIndex = loadSettingsFileIndex;
+		//Map the matrix of rows and cols to file number
+		loadSettingsFileIndex = ((row-1) * 6) + col; //6 is length of line
+		//TODO: DRY
+		//Transition from current setting to the next one
+		startTransition(relateiveDataPath + "settings" + std::to_string(oldSettingsFileIndex) + ".xml",
+			relateiveDataPath + "settings" + std::to_string(loadSettingsFileIndex) + ".xml");
+	}
+
+	if (m.getAddress() == "/settings/flip_ir_camera" &&
+		m.getArgAsBool(0) == true) {
+		if (isPsEyeSource()) {
+			doFlipCamera = !doFlipCamera;
 		}
+	}
 
-        if (m.getAddress() == "/settings/ir_autogain" &&
-            m.getArgAsBool(0) == true) {
-			useAgc.set(!useAgc);
-			if (eye) {
-				eye->setAutogain(useAgc);
-			}
+    if (m.getAddress() == "/settings/ir_autogain" &&
+        m.getArgAsBool(0) == true) {
+		useAgc.set(!useAgc);
+		if (useAgc) {
+			psEyeSoftwareAec.set(false);
+		}
+		if (eye) {
+			eye->setAutogain(useAgc);
 		}
-        
-        if (m.getAddress() == "/settings/show_logo") {
-            showLogo.set(m.getArgAsBool(0));
-        }
-
-        
-        if (m.getAddress() == "/settings/update_setting_file" &&
-            m.getArgAsBool(0) == true) {
-            updateSettingFile();
-        }
-        
-        //If the user send a manual command - auto pilot will turn off
+	}
+
+	if (m.getAddress() == "/settings/ir_software_aec" &&
+		m.getArgAsBool(0) == true) {
+		psEyeSoftwareAec.set(!psEyeSoftwareAec);
+	}
+    
+    if (m.getAddress() == "/settings/show_logo") {
+        showLogo.set(m.getArgAsBool(0));
+    }
+
+    
+    if (m.getAddress() == "/settings/update_setting_file" &&
+        m.getArgAsBool(0) == true) {
+        updateSettingFile();
+    }
+    
+    //If the user send a manual command - auto pilot will turn off
 //        if(doJumpBetweenStates == 1) {
 //            ofLogWarning("User took control. got osc message. auto pilot turned off");
 //            doJumpBetweenStates.set(0);
 //        }
-	}
-    
-//    Activate auto pilot to on if no message was received for a given period (30 seconds) and no auto pilot is set yet
-//    float timeSinceLastMessage = ofGetElapsedTimef() - lastOscMessageTime;
-//    if(timeSinceLastMessage >= AUTO_PILOT_TIMEOUT && doJumpBetweenStates.get() != 1) {
-//        lastOscMessageTime = ofGetElapsedTimef();
-//        doJumpBetweenStates.set(1);
-//        ofLogWarning("No osc message received for the last 15 seconds. moving to auto pilot");
-//    }
 }
 
 void ofApp::setMousePosition(float x, float y) {
@@ -877,7 +1395,7 @@ void ofApp::setMousePosition(float x, float y) {
 }
 
 void ofApp::startTransition(string settings1Path, string settings2Path) {
-	transitionStartTime = ofGetElapsedTimef();
+	transitionStartTime = clock.getElapsedTimef();
 	settingsFrom = new ofxXmlSettings(settings1Path);
 	settingsFromPath = settings1Path;
 	settingsTo = new ofxXmlSettings(settings2Path);
@@ -890,7 +1408,7 @@ void ofApp::updateTransition() {
 	if (isTransitionFinished)
 		return;
 
-	float timeSinceAnimationStart = ofGetElapsedTimef() - transitionStartTime;
+	float timeSinceAnimationStart = clock.getElapsedTimef() - transitionStartTime;
 
 	// Check if animation completed
 	if (timeSinceAnimationStart >= transitionTime) {
@@ -1050,7 +1568,7 @@ void ofApp::reset() {
 //--------------------------------------------------------------
 void ofApp::keyPressed(int key) {
     // Reset the last message received so auto pilot won't start
-    lastOscMessageTime = ofGetElapsedTimef();
+    lastOscMessageTime = clock.getElapsedTimef();
 	switch (key) {
 	case OF_KEY_TAB:
 	case 'G':
@@ -1075,7 +1593,7 @@ void ofApp::keyPressed(int key) {
 
 	case 'z':
 	case 'Z':
-		sourceMode.set((sourceMode.get() + 1) % SOURCE_COUNT);
+		sourceMode.set(getNextSourceMode());
 		break;
 	case 'x':
 	case 'X':
@@ -1239,7 +1757,13 @@ void ofApp::setLoadSettingsName(int &fileIndex) {
 
 //--------------------------------------------------------------
 void ofApp::draw() {
-	if (sendToSpout) {
+	if (offlineRender.isEnabled() && isOfflineRenderDone()) {
+		offlineRender.finish();
+		ofExit();
+		return;
+	}
+
+	if (isRenderingToFbo()) {
 		globalFbo.begin();
 	}
 	ofClear(0, 0);
@@ -1270,9 +1794,15 @@ void ofApp::draw() {
 	case DRAW_VELDOTS: drawVelocityDots(); break;
 	case DRAW_DISPLACEMENT: drawVelocityDisplacement(); break;
 	}
-	if (sendToSpout) {
+	if (isRenderingToFbo()) {
 		globalFbo.end();
 	}
+	if (offlineRender.isEnabled()) {
+		offlineRender.addFrame(globalFbo);
+		if (offlineRender.getFrameCount() % 600 == 0) {
+			ofLogNotice() << "Rendered " << offlineRender.getFrameCount() << " frames, " << ofGetFrameRate() << " fps";
+		}
+	}
 #ifdef _WIN32
 	if (!spoutInitialized) {
 		int spoutRandom = rand() % 1000 + 1;
@@ -1292,12 +1822,13 @@ void ofApp::draw() {
 		senderSpout.SendTexture(texData.textureID, texData.textureTarget, internalWidth, internalHeight, false);
 	}
 #endif
-	if (sendToSpout) {
+	if (isRenderingToFbo()) {
 		ofPushStyle();
 		ofEnableBlendMode(OF_BLENDMODE_DISABLED);
 		globalFbo.draw(0, 0, ofGetWidth(), ofGetHeight());
 		ofPopStyle();
 	}
+	latency.mark(ofxLatencyMonitor::STAGE_DRAW);
 	if (toggleGuiDraw)
 	{
 		ofShowCursor();
@@ -1490,12 +2021,12 @@ void ofApp::drawOpticalFlow(int _x, int _y, int _width, int _height) {
 	ofPushStyle();
 	if (showScalar.get()) {
 		ofEnableBlendMode(OF_BLENDMODE_ALPHA);
-		displayScalar.setSource(opticalFlow.getOpticalFlowDecay());
+		displayScalar.setSource(getOpticalFlowDecay());
 		displayScalar.draw(0, 0, _width, _height);
 	}
 	if (showField.get()) {
 		ofEnableBlendMode(OF_BLENDMODE_ADD);
-		velocityField.setVelocity(opticalFlow.getOpticalFlowDecay());
+		velocityField.setVelocity(getOpticalFlowDecay());
 		velocityField.draw(0, 0, _width, _height);
 	}
 	ofPopStyle();
@@ -1560,7 +2091,7 @@ void ofApp::drawVelocityDots(int _x, int _y, int _width, int _height) {
 void ofApp::drawVelocityDisplacement(int _x, int _y, int _width, int _height) {
 	ofPushStyle();
 	ofEnableBlendMode(OF_BLENDMODE_ADD);
-	velocityOffset.setColorMap(cameraFbo.getTextureReference());
+	velocityOffset.setColorMap(cameraPyramid.getLevel(velocityOffset.getWidth(), velocityOffset.getHeight()));
 	velocityOffset.setSource(fluidSimulation.getVelocity());
 	velocityOffset.draw(_x, _y, _width, _height);
 	ofPopStyle();
@@ -1598,8 +2129,8 @@ void ofApp::drawGui() {
 }
 
 void ofApp::startJumpBetweenStates(bool&) {
-	jumpBetweenStatesStartTime = ofGetElapsedTimef();
-    lastOscMessageTime = ofGetElapsedTimef(); //This to emulate the fact that user manually set to on
+	jumpBetweenStatesStartTime = clock.getElapsedTimef();
+    lastOscMessageTime = clock.getElapsedTimef(); //This to emulate the fact that user manually set to on
 }
 
 void ofApp::updateNumberOfSettingFiles() {
@@ -1695,6 +2226,9 @@ string ofApp::dirnameOf(const string& fname)
 }
 
 void ofApp::exit() {
+	offlineRender.finish();
+	sessionRecorder.stop();
+	sourceManager.close();
 #ifdef _WIN32
 	senderSpout.ReleaseSender(); // Release the sender
 #endif
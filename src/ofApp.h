@@ -16,15 +16,36 @@
 #include "ofxXmlSettings.h"
 #include "ofxOsc.h"
 
+#include "ofxFrameSource.h"
 #ifdef _KINECT
-#include "ofxKinectForWindows2.h"
+#include "ofxKinectSource.h"
+#else
+#include "ofxKinectStandIn.h"
 #endif
-
-#include "ps3eye.h"
+#include "ofxWebcamSource.h"
+#include "ofxVideoSource.h"
+#include "ofxPsEyeSource.h"
+#include "ofxGstPipelineSource.h"
+#include "ofxDualSource.h"
+#include "ofxPsEyeRig.h"
+#include "ofxSourceManager.h"
+#include "ofxSessionRecorder.h"
+#include "ofxSessionSource.h"
+#include "ofxClock.h"
+#include "ofxOfflineRender.h"
+#include "ofxLatencyMonitor.h"
+#include "ofxPresenceDetector.h"
+#include "ofxCameraRemap.h"
+#include "ofxResolutionProfile.h"
+#include "ofxFlowCache.h"
 
 #include "ofxRecolor.h"
 #include "ftVelocityOffset.h"
 #include "ftDrawMasked.h"
+#include "ftBackgroundModel.h"
+#include "ftTemporalDenoise.h"
+#include "ftFrameInterpolator.h"
+#include "ftSourcePyramid.h"
 
 #include "ofxMouse.h"
 
@@ -54,9 +75,12 @@ enum drawModeEnum {
 };
 
 enum sourceModeEnum {
-	SOURCE_KINECT = 0,
+	SOURCE_KINECT = 0, // the sensor on windows, elsewhere the webcam unless --kinect-recording names a recording
 	SOURCE_PS3EYE,
 	SOURCE_VIDEO,
+	SOURCE_PIPELINE, // gstreamer pipeline, linux only
+	SOURCE_SESSION, // replay of a recorded session
+	SOURCE_KINECT_PSEYE, // kinect depth and a PS3Eye merged, needs a kinect like SOURCE_KINECT
 	SOURCE_COUNT
 };
 
@@ -70,31 +94,81 @@ enum transitionModeEnum {
 class ofApp : public ofBaseApp {
 public:
 	void	setup();
-	void	setupPsEye();
-	void	setupVideoSource();
+	bool	setupPsEye(bool speculative = false);
+	bool	setupVideoSource();
 	void	update();
 	void	draw();
 	void	exit();
 
-	// Camera
-	ofVideoGrabber		simpleCam;
+	// Camera. Every source captures on its own thread, update() only picks up their newest frames
+	ofxWebcamSource		webcamSource;
 #ifdef _KINECT
-	ofxKFW2::Device		kinect;
-	ftFbo				kinectFbo;
+	ofxKinectSource		kinectSource;
+#else
+	ofxKinectStandIn	kinectSource; // a recorded kinect without the sensor
+#endif
+	string				kinectRecording; // from the command line, a session the stand-in replays off windows
+	bool				hasKinect();
+	ftFbo				kinectFbo; // users-only depth, also for replayed kinect sessions
+	ofTexture&			filterDepthUsers(ofTexture& depth, ofTexture& bodyIndex, int bodyCount);
+	ftTemporalDenoise	depthDenoise; // kinect and replayed depth
+	ftTemporalDenoise	cameraDenoise; // every other source
+	ofTexture&			denoise(ftTemporalDenoise& stage, ofTexture& source);
+	ofxPsEyeSource		psEyeSource;
+	ofxPsEyeRig			psEyeRig; // all connected eyes stitched into one source
+	ofxVideoSource		videoSource;
+#ifdef TARGET_LINUX
+	ofxGstPipelineSource pipelineSource;
 #endif
-	ps3eye::PS3EYECam::PS3EYERef eye = NULL;
-	unsigned char *		videoFrame;
-	ofTexture			videoTexture;
+	ofxDualSource		dualSource; // kinect and psEye at the same time
+	ofParameter<string>	gstPipeline; // gst-launch style description of the pipeline source
+	void				onGstPipelineChanged(string &);
+	ofxFrameSource&		getSource(int mode);
+	ofxFrameSource&		getActiveSource() { return getSource(sourceMode.get()); }
+	bool				openSource(int mode, bool speculative = false);
+	ofxSourceManager	sourceManager; // parks idle sources and pre-opens the next one
+	int					predictNextSourceMode();
+	bool				isSourceAvailable(int mode);
+	int					getNextSourceMode();
+	string				nextSettingsKey; // settings file predictNextSourceMode() last looked into
+	int					nextSettingsSourceMode;
+	ofParameter<bool>	psEyeMultiCamera;
+
+	// Session recording / replay
+	ofxSessionRecorder	sessionRecorder;
+	ofxSessionSource	sessionSource;
+	ofParameterGroup	sessionParameters;
+	ofParameter<bool>	recordSession;
+	ofParameter<string>	sessionFile; // replayed by SOURCE_SESSION
+	ofParameter<float>	sessionStartTime;
+	ofParameter<float>	sessionSpeed; // 0 replays one recorded frame per app frame
+	void				onRecordSessionChanged(bool &);
+	void				onSessionFileChanged(string &);
+	void				onSessionSpeedChanged(float &);
+	void				onGuiParameterChanged(ofAbstractParameter &);
+	void				applySessionEvents();
+	void				applyParameterChange(const string& path, const string& value);
+	bool				setupPsEyeRig(bool speculative = false);
+	void				onPsEyeMultiCameraChanged(bool &);
 
 	bool				isKinectSource();
 	bool				isPsEyeSource();
 	bool				isVideoSource();
+	bool				isSessionSource();
 	bool				isKinectAndPsEyeSource();
 
 
 	bool				didCamUpdate;
+	// the last frame recolor, optical flow and the velocity mask ran on
+	ofxFrameSource*		processedSource;
+	uint64_t			processedSequence;
+	float				processedTime;
+	ofParameter<float>	staleFlowHalfLife; // seconds, the last flow fades while no new frame comes in. 0 keeps it
+	bool				isUnprocessedFrame();
 	ftFbo				cameraFbo;
+	ftSourcePyramid		cameraPyramid; // cameraFbo at the resolutions the passes read it at
 	ofParameter<bool>	doFlipCamera;
+	ofxCameraRemap		cameraRemap; // undistortion and projector alignment of the active source, flip included
 	ofFbo				globalFbo;
 	bool				spoutInitialized;
 #ifdef _WIN32
@@ -102,20 +176,34 @@ public:
 #endif
 
 	// Time
-	float				lastTime;
+	ofxClock			clock; // everything animates by this, fixed steps in an offline render
 	float				deltaTime;
+	ofxLatencyMonitor	latency; // capture to screen, per stage
     // We will use this to know when was the last time user touched the system
     // by doing so we will go to auto pilot
     float				lastOscMessageTime;
 
 	// FlowTools
-	int				    internalWidth; // base resolution for intermediate buffers
+	ofxResolutionProfile resolution; // of every stage, from resolution.xml
+	string				resolutionProfileName; // from the command line, the one resolution.xml selects if empty
+	int				    internalWidth; // output resolution
 	int					internalHeight;
+	int					sourceWidth; // cameraFbo and the passes that make it
+	int					sourceHeight;
 	int					flowWidth; // base resolution for fluid simulation buffers
 	int					flowHeight; // usually 1/4 of internalWidth/Height
+	int					maskWidth;
+	int					maskHeight;
+
+	// Offline render: fixed steps, input from a session or video, frames written to image files
+	ofxOfflineRender::Settings offlineSettings; // from the command line
+	ofxOfflineRender	offlineRender;
+	void				setupOfflineRender();
+	bool				isOfflineRenderDone();
+	bool				isRenderingToFbo() const { return sendToSpout || offlineRender.isEnabled(); }
 
 	int getDrawWidth() const {
-		if (sendToSpout) {
+		if (isRenderingToFbo()) {
 			return internalWidth;
 		}
 		else {
@@ -124,7 +212,7 @@ public:
 	}
 
 	int getDrawHeight() const {
-		if (sendToSpout) {
+		if (isRenderingToFbo()) {
 			return internalHeight;
 		}
 		else {
@@ -133,6 +221,17 @@ public:
 	}
 	ftOpticalFlow		opticalFlow;
 	ftVelocityMask		velocityMask;
+	ftBackgroundModel	backgroundModel; // people only for the sources without a body index
+	ofxPresenceDetector	presence; // drives the people-only filters on autopilot
+	bool				hasBodyIndex; // the current input is depth with a body index
+	ofTexture*			flowInput; // what the optical flow of the last camera frame ran on
+	ftFrameInterpolator	frameInterpolator; // camera frames warped on to every render tick
+	ftFbo				interpolatedMaskInputFbo; // the pyramid level the velocity mask reads, warped
+	ftFbo				interpolatedFlowInputFbo;
+	ofxFlowCache		flowCache; // optical flow of looping video clips, computed once
+	bool				isFlowFromCache; // the flow of the last frame came from flowCache
+	ofTexture&			getOpticalFlow() { return isFlowFromCache ? flowCache.getFlow() : opticalFlow.getOpticalFlow(); }
+	ofTexture&			getOpticalFlowDecay() { return isFlowFromCache ? flowCache.getFlowDecay() : opticalFlow.getOpticalFlowDecay(); }
 	ftFluidSimulation	fluidSimulation;
 	ftParticleFlow		particleFlow;
 
@@ -271,9 +370,9 @@ public:
 	void				startJumpBetweenStates(bool&);
 	void				updateNumberOfSettingFiles();
 	void				checkIfPersonIdentified();
-	int					getNumberOfTrackedBodies();
 	void				updateJumpBetweenStates();
 	void				updateOscMessages();
+	void				handleOscMessage(ofxOscMessage& m);
 	void				startTransition(string settings1Path, string settings2Path);
 	void				updateTransition();
 	void				updateGuiFromTag(float timeSinceAnimationStart, string tag, string oscMsgPath = "");
@@ -300,6 +399,14 @@ public:
 	ofParameter<bool>	kinectFilterUsers; // filter out users only for kinect
 	ofParameter<bool>   psEyeRawOpticalFlow; // optical flow on raw data and not recolored
 	ofParameter<bool>   useAgc; // automatic gain control for ps eye
+	ofParameter<bool>   psEyeRawBayer; // capture raw bayer (1 byte per pixel) and demosaic on the gpu
+	void				onPsEyeRawBayerChanged(bool &);
+	ofParameter<bool>   psEyeSoftwareAec; // driver side auto exposure instead of the sensor AGC
+	ofParameter<int>    psEyeAecTarget;
+	ofParameter<float>  psEyeAecSpeed;
+	void				onPsEyeSoftwareAecChanged(bool &);
+	void				onPsEyeAecTargetChanged(int &);
+	void				onPsEyeAecSpeedChanged(float &);
 
 	float				timeSinceLastTimeAPersonWasInFrame; // When no people is detected we can show the background
 
@@ -309,6 +416,5 @@ public:
     void                jumpToNextPattern();
     void                updateSettingFile();
     void                cleanCurrentSettingFile();
-	ofVideoPlayer		videoPlayer;
 
 };
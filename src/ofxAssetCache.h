@@ -0,0 +1,169 @@
+//
+//  ofxAssetCache.h
+//  visionquest
+//
+//  Decoded startup assets (the recolor LUT images, the 3d noise volume) kept on disk in cache/assets, so
+//  the app only decodes or generates what changed since the last start. An entry is named by the hash of
+//  everything it is made from (file contents, size limits, generator parameters), so a changed source is
+//  simply a new entry. An entry is a Header followed by the texel data exactly as it is uploaded:
+//  width * height * depth * channels bytes, rows tightly packed.
+//  Whatever isn't cached is decoded or generated on all cores, then stored.
+//
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include "ofMain.h"
+
+class ofxAssetCache {
+	static const uint32_t VERSION = 1;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t depth;
+		uint32_t channels;
+		uint64_t key;
+	};
+
+	string directory;
+
+	string getPath(uint64_t key) const {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.vqa", (unsigned long long)key);
+		return ofToDataPath(directory + "/" + name, true);
+	}
+
+	// texel data stored under key, false if there is none
+	bool read(uint64_t key, Header& header, vector<uint8_t>& data) const {
+		FILE* file = fopen(getPath(key).c_str(), "rb");
+		if (!file)
+			return false;
+		bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "VQAC", 4) == 0 &&
+			header.version == VERSION && header.key == key;
+		if (valid) {
+			data.resize((size_t)header.width * header.height * header.depth * header.channels);
+			valid = fread(data.data(), 1, data.size(), file) == data.size();
+		}
+		fclose(file);
+		return valid;
+	}
+
+	// through a temporary file, other instances may be starting at the same time
+	void write(uint64_t key, int width, int height, int depth, int channels, const uint8_t* data) const {
+		Header header;
+		memcpy(header.magic, "VQAC", 4);
+		header.version = VERSION;
+		header.width = width;
+		header.height = height;
+		header.depth = depth;
+		header.channels = channels;
+		header.key = key;
+		string path = getPath(key);
+		string temporary = path + "." + ofToString(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (!file) {
+			ofLogWarning("ofxAssetCache") << "can't write " << temporary;
+			return;
+		}
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(data, 1, (size_t)width * height * depth * channels, file) == (size_t)width * height * depth * channels;
+		fclose(file);
+		if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+			remove(temporary.c_str());
+		}
+	}
+
+	// f(0) .. f(count - 1) on all cores
+	static void parallelFor(int count, std::function<void(int)> f) {
+		std::atomic<int> next(0);
+		int workers = MIN(MAX((int)std::thread::hardware_concurrency(), 1), count);
+		vector<std::thread> threads;
+		for (int i = 0; i < workers; i++) {
+			threads.push_back(std::thread([&] {
+				for (int n = next++; n < count; n = next++) {
+					f(n);
+				}
+			}));
+		}
+		for (size_t i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+	}
+
+public:
+	static const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+	// FNV-1a
+	static void hash(uint64_t& h, const void* data, size_t size) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < size; i++) {
+			h = (h ^ bytes[i]) * 1099511628211ULL;
+		}
+	}
+
+	ofxAssetCache() : directory("cache/assets") {}
+
+	void setup(const string& _directory) { directory = _directory; }
+
+	// Decodes images, scaled down to fit maxSize x maxSize if that is > 0. Unreadable ones are unallocated
+	void loadImages(const vector<string>& paths, int maxSize, vector<ofPixels>& images) {
+		ofDirectory::createDirectory(directory, true, true);
+		images.clear();
+		images.resize(paths.size());
+		std::atomic<int> decoded(0);
+		parallelFor(paths.size(), [&](int i) {
+			ofBuffer file = ofBufferFromFile(paths[i], true);
+			if (!file.size())
+				return;
+			uint64_t key = HASH_SEED;
+			hash(key, "image", 5);
+			hash(key, &maxSize, sizeof(maxSize));
+			hash(key, file.getData(), file.size());
+
+			Header header;
+			vector<uint8_t> data;
+			if (read(key, header, data)) {
+				images[i].setFromPixels(data.data(), header.width, header.height, header.channels);
+				return;
+			}
+			ofPixels& pixels = images[i];
+			if (!ofLoadImage(pixels, file)) {
+				ofLogError("ofxAssetCache") << "can't decode " << paths[i];
+				return;
+			}
+			if (maxSize > 0 && (pixels.getWidth() > (size_t)maxSize || pixels.getHeight() > (size_t)maxSize)) {
+				float scale = (float)maxSize / MAX(pixels.getWidth(), pixels.getHeight());
+				pixels.resize(MAX(pixels.getWidth() * scale, 1), MAX(pixels.getHeight() * scale, 1));
+			}
+			write(key, pixels.getWidth(), pixels.getHeight(), 1, pixels.getNumChannels(), pixels.getData());
+			decoded++;
+		});
+		ofLogNotice("ofxAssetCache") << paths.size() << " images, " << decoded << " decoded, the rest cached";
+	}
+
+	// A size^3 volume of channels bytes per texel, stored under a key made of name and params. If it isn't
+	// cached generate(x, slice) fills the size^2 texels of every x slice, in parallel
+	void loadVolume(const string& name, const string& params, int size, int channels, std::function<void(int, uint8_t*)> generate, vector<uint8_t>& volume) {
+		ofDirectory::createDirectory(directory, true, true);
+		uint64_t key = HASH_SEED;
+		hash(key, name.data(), name.size());
+		hash(key, params.data(), params.size());
+		hash(key, &size, sizeof(size));
+		hash(key, &channels, sizeof(channels));
+
+		Header header;
+		if (read(key, header, volume))
+			return;
+		size_t sliceBytes = (size_t)size * size * channels;
+		volume.resize(sliceBytes * size);
+		parallelFor(size, [&](int x) {
+			generate(x, volume.data() + x * sliceBytes);
+		});
+		write(key, size, size, size, channels, volume.data());
+		ofLogNotice("ofxAssetCache") << "generated " << name;
+	}
+};
@@ -0,0 +1,151 @@
+//
+//  ofxCameraRemap.h
+//  visionquest
+//
+//  Lens undistortion, the projector alignment homography and the camera flip folded into one remap
+//  texture. For every output pixel it holds the normalized source coordinate to fetch, so recolor corrects
+//  the camera while it writes cameraFbo, with one extra texture fetch and no extra pass. The texture is
+//  computed on the cpu whenever the calibration or the flip changes, at a quarter of the output resolution:
+//  the mapping is smooth and the fetch interpolates it.
+//
+//  Calibration files are per source, calibration/<source name>.xml:
+//    <calibration>
+//      <width>640</width> <height>480</height>    image size the intrinsics are in
+//      <fx/> <fy/> <cx/> <cy/>                     camera matrix, pixels
+//      <k1/> <k2/> <p1/> <p2/> <k3/>               distortion, as OpenCV calibrates it
+//      <homography>1 0 0 0 1 0 0 0 1</homography>  row major, output 0..1 to undistorted image 0..1
+//    </calibration>
+//  A source without a file is only flipped.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxXmlSettings.h"
+
+class ofxCameraRemap {
+public:
+	struct Calibration {
+		float width, height;
+		float fx, fy, cx, cy;
+		float k1, k2, p1, p2, k3;
+		float homography[9];
+
+		Calibration() : width(1), height(1), fx(1), fy(1), cx(0.5), cy(0.5), k1(0), k2(0), p1(0), p2(0), k3(0) {
+			for (int i = 0; i < 9; i++) {
+				homography[i] = (i % 4 == 0) ? 1 : 0;
+			}
+		}
+	};
+
+private:
+	Calibration calibration;
+	bool calibrated; // a file was loaded
+	bool flip;
+	bool dirty;
+	int width;
+	int height;
+	ofFloatPixels remap;
+	ofTexture texture;
+
+	// output 0..1 to source 0..1
+	ofVec2f map(float u, float v) const {
+		if (flip)
+			u = 1 - u;
+		const float* h = calibration.homography;
+		float w = h[6] * u + h[7] * v + h[8];
+		float hu = (h[0] * u + h[1] * v + h[2]) / w;
+		float hv = (h[3] * u + h[4] * v + h[5]) / w;
+
+		// forward Brown-Conrady: where the ideal pinhole ray lands on the distorted sensor
+		float x = (hu * calibration.width - calibration.cx) / calibration.fx;
+		float y = (hv * calibration.height - calibration.cy) / calibration.fy;
+		float r2 = x * x + y * y;
+		float radial = 1 + r2 * (calibration.k1 + r2 * (calibration.k2 + r2 * calibration.k3));
+		float xd = x * radial + 2 * calibration.p1 * x * y + calibration.p2 * (r2 + 2 * x * x);
+		float yd = y * radial + calibration.p1 * (r2 + 2 * y * y) + 2 * calibration.p2 * x * y;
+		return ofVec2f((xd * calibration.fx + calibration.cx) / calibration.width, (yd * calibration.fy + calibration.cy) / calibration.height);
+	}
+
+	void build() {
+		remap.allocate(width, height, 2);
+		float* data = remap.getData();
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				// at the texel centers, where the linear fetch returns them exactly
+				ofVec2f coord = map((x + 0.5f) / width, (y + 0.5f) / height);
+				*data++ = coord.x;
+				*data++ = coord.y;
+			}
+		}
+		if (!texture.isAllocated() || texture.getWidth() != width || texture.getHeight() != height) {
+			texture.allocate(width, height, GL_RG32F);
+			texture.setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
+			texture.setTextureWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+		}
+		texture.loadData(remap.getData(), width, height, GL_RG);
+		dirty = false;
+	}
+
+public:
+	ofParameterGroup parameters;
+	ofParameter<bool> enabled;
+
+	ofxCameraRemap() : calibrated(false), flip(false), dirty(true), width(320), height(180) {
+		parameters.setName("camera remap");
+		parameters.add(enabled.set("Undistort / align", true));
+	}
+
+	// remap texture size, about a quarter of the output
+	void setup(int _width, int _height) {
+		width = MAX(_width, 2);
+		height = MAX(_height, 2);
+		dirty = true;
+	}
+
+	// Loads the calibration of a source, false (and no correction) if there is none
+	bool load(const string& path) {
+		calibration = Calibration();
+		calibrated = false;
+		dirty = true;
+		ofxXmlSettings xml;
+		if (!ofFile::doesFileExist(path) || !xml.load(path))
+			return false;
+		calibration.width = xml.getValue("calibration:width", 640.0);
+		calibration.height = xml.getValue("calibration:height", 480.0);
+		calibration.fx = xml.getValue("calibration:fx", calibration.width);
+		calibration.fy = xml.getValue("calibration:fy", calibration.width);
+		calibration.cx = xml.getValue("calibration:cx", calibration.width * 0.5);
+		calibration.cy = xml.getValue("calibration:cy", calibration.height * 0.5);
+		calibration.k1 = xml.getValue("calibration:k1", 0.0);
+		calibration.k2 = xml.getValue("calibration:k2", 0.0);
+		calibration.p1 = xml.getValue("calibration:p1", 0.0);
+		calibration.p2 = xml.getValue("calibration:p2", 0.0);
+		calibration.k3 = xml.getValue("calibration:k3", 0.0);
+		vector<string> values = ofSplitString(xml.getValue("calibration:homography", string("")), " ", true, true);
+		if (values.size() == 9) {
+			for (int i = 0; i < 9; i++) {
+				calibration.homography[i] = ofToFloat(values[i]);
+			}
+		}
+		calibrated = true;
+		ofLogNotice("ofxCameraRemap") << "loaded " << path;
+		return true;
+	}
+
+	bool isCalibrated() const { return calibrated; }
+
+	// The remap for the current calibration with the flip folded in, NULL when there is nothing to correct
+	ofTexture* update(bool _flip) {
+		if (!enabled || !calibrated)
+			return NULL;
+		if (_flip != flip) {
+			flip = _flip;
+			dirty = true;
+		}
+		if (dirty) {
+			build();
+		}
+		return &texture;
+	}
+};
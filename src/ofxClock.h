@@ -0,0 +1,43 @@
+//
+//  ofxClock.h
+//  visionquest
+//
+//  The time everything animates by. Live it follows ofGetElapsedTimef(), in an offline render it advances
+//  by a fixed step every frame, so a render does not depend on how long the frames took to compute.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+class ofxClock {
+	double step; // 0 follows the wall clock
+	double time;
+	double deltaTime;
+	uint64_t frame;
+
+public:
+	ofxClock() : step(0), time(0), deltaTime(0), frame(0) {}
+
+	// restarts at 0 when set to a fixed step
+	void setFixedStep(double _step) {
+		step = _step;
+		time = step > 0 ? 0 : ofGetElapsedTimef();
+		deltaTime = 0;
+		frame = 0;
+	}
+	bool isFixedStep() const { return step > 0; }
+	double getFixedStep() const { return step; }
+
+	// once per app frame
+	void update() {
+		double now = step > 0 ? time + step : ofGetElapsedTimef();
+		deltaTime = frame ? now - time : step;
+		time = now;
+		frame++;
+	}
+
+	float getElapsedTimef() const { return step > 0 ? (float)time : ofGetElapsedTimef(); }
+	float getDeltaTime() const { return (float)deltaTime; }
+	uint64_t getFrameNum() const { return frame; }
+};
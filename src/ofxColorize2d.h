@@ -15,8 +15,9 @@
 
 class ofxColorize2d : public flowTools::ftShader {
     ofTexture defaultLut;
+    ofTexture* remap;
 public:
-    ofxColorize2d() {
+    ofxColorize2d() : remap(NULL) {
         
         ofLogVerbose("init ftToScalarShader");
         if (ofIsGLProgrammableRenderer())
@@ -53,13 +54,25 @@ protected:
                                  uniform vec2 position;
                                  uniform vec2 direction;
                                  uniform float blendFactor;
+                                 uniform sampler2DRect remap;
+                                 uniform vec2 remapSize; // 0 without a remap
+                                 uniform vec2 sourceSize;
                                  
                                  in vec2 texCoordVarying;
                                  out vec4 fragColor;
                                  
                                  void main(){
+                                     vec2 sourceCoord = texCoordVarying;
+                                     if (remapSize.x > 0.0) {
+                                         sourceCoord = texture(remap, texCoordVarying / sourceSize * remapSize).rg;
+                                         if (any(lessThan(sourceCoord, vec2(0.0))) || any(greaterThan(sourceCoord, vec2(1.0)))) {
+                                             fragColor = vec4(0.0);
+                                             return;
+                                         }
+                                         sourceCoord *= sourceSize;
+                                     }
                                      //vec4 color = texture(source, texCoordVarying);
-                                     float textureCoord = texture(source, texCoordVarying).r;
+                                     float textureCoord = texture(source, sourceCoord).r;
                                      // cutoffs
                                      if ((textureCoord == 0) || (textureCoord > cutoff)) {
                                          fragColor = vec4(0.0);
@@ -79,6 +92,9 @@ protected:
     
 public:
     
+    // see ofxCameraRemap, the flip is part of it. NULL draws the source as is
+    void setRemap(ofTexture* _remap) { remap = _remap; }
+    
     void update(ofFbo& _buffer, ofTexture& _scalarTexture, ofTexture& _lut, ofTexture& _lut2, bool _mirror, float _blendFactor, float _scale = 0.5, float _offsetX = 0, float _offsetY = 0, float _cutoff = 1.0, float _dx = 1.0, float _dy = 0.0){
         _buffer.begin();
         shader.begin();
@@ -89,7 +105,11 @@ public:
         shader.setUniform2f("direction", _dx*_scale/_cutoff, _dy*_scale/_cutoff);
         shader.setUniform1f("cutoff", _cutoff);
         shader.setUniform1f("blendFactor", _blendFactor);
-        if (!_mirror) {
+        // unused samplers still need a valid texture bound
+        shader.setUniformTexture("remap", remap ? *remap : _scalarTexture, 3);
+        shader.setUniform2f("remapSize", remap ? remap->getWidth() : 0, remap ? remap->getHeight() : 0);
+        shader.setUniform2f("sourceSize", _scalarTexture.getWidth(), _scalarTexture.getHeight());
+        if (!_mirror || remap) {
             renderFrame(_buffer.getWidth(), _buffer.getHeight(), _scalarTexture.getWidth(), _scalarTexture.getHeight());
         } else {
             renderFrameMirrored(_buffer.getWidth(), _buffer.getHeight(), _scalarTexture.getWidth(), _scalarTexture.getHeight());
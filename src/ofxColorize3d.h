@@ -15,8 +15,9 @@
 
 class ofxColorize3d : public flowTools::ftShader {
     ofTexture defaultLut;
+    ofTexture* remap;
 public:
-    ofxColorize3d() {
+    ofxColorize3d() : remap(NULL) {
         
         ofLogVerbose("init ftToScalarShader");
         if (ofIsGLProgrammableRenderer())
@@ -55,6 +56,8 @@ protected:
                                  uniform float blendFactor;
                                  uniform vec2 size; // size of the source texture
                                  uniform float scale;
+                                 uniform sampler2DRect remap;
+                                 uniform vec2 remapSize; // 0 without a remap
                                  
                                  const vec2 xyToZ = vec2(1.01447, 0.789809);
                                  const float texToDepth = 65.536; // 65536/1000
@@ -64,10 +67,19 @@ protected:
                                  out vec4 fragColor;
                                  
                                  void main(){
+                                     vec2 sourceCoord = texCoordVarying;
+                                     if (remapSize.x > 0.0) {
+                                         sourceCoord = texture(remap, texCoordVarying / size * remapSize).rg;
+                                         if (any(lessThan(sourceCoord, vec2(0.0))) || any(greaterThan(sourceCoord, vec2(1.0)))) {
+                                             fragColor = vec4(0.0);
+                                             return;
+                                         }
+                                         sourceCoord *= size;
+                                     }
                                      //vec4 color = texture(source, texCoordVarying);
-                                     float normalizedZ = texture(source, texCoordVarying).r;
+                                     float normalizedZ = texture(source, sourceCoord).r;
                                      float z = normalizedZ*texToDepth;
-                                     vec3 realWorld = vec3((texCoordVarying/size - 0.5) * xyToZ * z, z*2);
+                                     vec3 realWorld = vec3((sourceCoord/size - 0.5) * xyToZ * z, z*2);
                                      
                                        // cutoffs
                                      if ((normalizedZ == 0) || (normalizedZ > cutoff)) {
@@ -91,6 +103,9 @@ protected:
     
 public:
     
+    // see ofxCameraRemap, the flip is part of it. NULL draws the source as is
+    void setRemap(ofTexture* _remap) { remap = _remap; }
+    
     void update(ofFbo& _buffer, ofTexture& _scalarTexture, GLuint _lut, GLuint _lut2, bool _mirror, float _blendFactor, float _scale = 0.5, float _offsetX = 0, float _offsetY = 0, float _cutoff = 1.0, float _dx = 1.0, float _dy = 0.0){
         _buffer.begin();
         shader.begin();
@@ -103,7 +118,10 @@ public:
         shader.setUniform1f("blendFactor", _blendFactor);
         shader.setUniform1f("scale", _scale);
         shader.setUniform2f("size", _scalarTexture.getWidth(), _scalarTexture.getHeight());
-        if (!_mirror) {
+        // unused samplers still need a valid texture bound
+        shader.setUniformTexture("remap", remap ? *remap : _scalarTexture, 3);
+        shader.setUniform2f("remapSize", remap ? remap->getWidth() : 0, remap ? remap->getHeight() : 0);
+        if (!_mirror || remap) {
             renderFrame(_buffer.getWidth(), _buffer.getHeight(), _scalarTexture.getWidth(), _scalarTexture.getHeight());
         } else {
             renderFrameMirrored(_buffer.getWidth(), _buffer.getHeight(), _scalarTexture.getWidth(), _scalarTexture.getHeight());
@@ -0,0 +1,193 @@
+//
+//  ofxDepthCodec.h
+//  visionquest
+//
+//  Lossless codec for 16 bit depth frames after RVL (Wilson, "Fast Lossless Depth Image Compression", 2017).
+//  The frame is coded as alternating runs: the length of a run of zeros (no depth), the length of the
+//  following run of valid pixels and the zigzagged difference of every valid pixel to the previous one.
+//  All numbers are variable length, 3 bits per nibble plus a continuation bit, packed into 32 bit words.
+//  Neighbouring depth pixels are close, so most differences fit in one or two nibbles and Kinect frames
+//  shrink about 3x or more, at well over a hundred frames per second on one core both ways.
+//  Encoder and Decoder stream: the pixels can be fed and pulled in any number of pieces, e.g. row by row.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxDepthCodec {
+
+	class Encoder {
+		vector<uint8_t>* out;
+		uint32_t word;
+		int nibbles; // in word
+		int previous;
+		uint32_t zeros; // of the current run
+		vector<uint16_t> values; // of the current run, written once the run ends
+
+		void put(uint32_t value) {
+			do {
+				uint32_t nibble = value & 0x7;
+				value >>= 3;
+				if (value)
+					nibble |= 0x8;
+				word = (word << 4) | nibble;
+				if (++nibbles == 8) {
+					flushWord();
+				}
+			} while (value);
+		}
+
+		void flushWord() {
+			size_t size = out->size();
+			out->resize(size + 4);
+			memcpy(out->data() + size, &word, 4);
+			word = 0;
+			nibbles = 0;
+		}
+
+		void flushRun() {
+			put(zeros);
+			put((uint32_t)values.size());
+			for (size_t i = 0; i < values.size(); i++) {
+				int delta = (int)values[i] - previous;
+				put((uint32_t)((delta << 1) ^ (delta >> 31))); // zigzag, small magnitudes become small numbers
+				previous = values[i];
+			}
+			zeros = 0;
+			values.clear();
+		}
+
+	public:
+		Encoder() : out(NULL), word(0), nibbles(0), previous(0), zeros(0) {}
+
+		// appends the coded frame to _out
+		void begin(vector<uint8_t>& _out) {
+			out = &_out;
+			word = 0;
+			nibbles = 0;
+			previous = 0;
+			zeros = 0;
+			values.clear();
+		}
+
+		void write(const uint16_t* pixels, size_t count) {
+			size_t i = 0;
+			while (i < count) {
+				if (pixels[i] == 0) {
+					if (!values.empty()) {
+						flushRun();
+					}
+					// skip the holes four pixels at a time
+					uint64_t quad;
+					while (i + 4 <= count && (memcpy(&quad, pixels + i, 8), quad == 0)) {
+						zeros += 4;
+						i += 4;
+					}
+					while (i < count && pixels[i] == 0) {
+						zeros++;
+						i++;
+					}
+				}
+				else {
+					values.push_back(pixels[i++]);
+				}
+			}
+		}
+
+		// ends the frame, returns the coded size
+		size_t finish() {
+			if (zeros || !values.empty()) {
+				flushRun();
+			}
+			if (nibbles) {
+				word <<= 4 * (8 - nibbles);
+				flushWord();
+			}
+			return out->size();
+		}
+	};
+
+	class Decoder {
+		const uint8_t* data;
+		const uint8_t* end;
+		uint32_t word;
+		int nibbles; // left in word
+		int previous;
+		uint32_t zeros; // left in the current run
+		uint32_t values;
+
+		bool get(uint32_t& value) {
+			value = 0;
+			for (int shift = 0; shift < 32; shift += 3) {
+				if (!nibbles) {
+					if (data + 4 > end)
+						return false;
+					memcpy(&word, data, 4);
+					data += 4;
+					nibbles = 8;
+				}
+				uint32_t nibble = word >> 28;
+				word <<= 4;
+				nibbles--;
+				value |= (nibble & 0x7) << shift;
+				if (!(nibble & 0x8))
+					return true;
+			}
+			return false;
+		}
+
+	public:
+		Decoder() : data(NULL), end(NULL), word(0), nibbles(0), previous(0), zeros(0), values(0) {}
+
+		void begin(const uint8_t* _data, size_t size) {
+			data = _data;
+			end = _data + size;
+			word = 0;
+			nibbles = 0;
+			previous = 0;
+			zeros = 0;
+			values = 0;
+		}
+
+		// false if the data ends early or is corrupt
+		bool read(uint16_t* pixels, size_t count) {
+			while (count) {
+				if (zeros) {
+					size_t n = MIN((size_t)zeros, count);
+					memset(pixels, 0, n * sizeof(uint16_t));
+					pixels += n;
+					count -= n;
+					zeros -= n;
+				}
+				else if (values) {
+					uint32_t zigzag;
+					if (!get(zigzag))
+						return false;
+					previous += (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+					*pixels++ = (uint16_t)previous;
+					count--;
+					values--;
+				}
+				else if (!get(zeros) || !get(values) || (!zeros && !values)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	inline size_t encode(const uint16_t* pixels, size_t count, vector<uint8_t>& out) {
+		Encoder encoder;
+		size_t start = out.size();
+		encoder.begin(out);
+		encoder.write(pixels, count);
+		return encoder.finish() - start;
+	}
+
+	inline bool decode(const uint8_t* data, size_t size, uint16_t* pixels, size_t count) {
+		Decoder decoder;
+		decoder.begin(data, size);
+		return decoder.read(pixels, count);
+	}
+}
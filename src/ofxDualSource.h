@@ -0,0 +1,119 @@
+//
+//  ofxDualSource.h
+//  visionquest
+//
+//  A depth source (the Kinect) and a camera (a PS3Eye) running at the same time, merged into one source.
+//  Both keep capturing on their own threads, update() picks up whatever either has new and merges the
+//  newest of both in a single GPU pass (ftMergeShader), with a weight per source and the camera registered
+//  onto the depth by an offset and a scale. The parts are opened and parked by the source manager like any
+//  other source, the dual source only merges them.
+//
+
+#pragma once
+
+#include <functional>
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ftMergeShader.h"
+#include "ofxFrameSource.h"
+
+class ofxDualSource : public ofxFrameSource {
+	ofxFrameSource* depth;
+	ofxFrameSource* camera;
+	std::function<ofTexture&()> getDepthTexture;
+	bool opened;
+
+	flowTools::ftMergeShader mergeShader;
+	flowTools::ftFbo mergeFbo;
+	int width;
+	int height;
+
+public:
+	ofParameterGroup parameters;
+	ofParameter<float> depthWeight;
+	ofParameter<float> cameraWeight;
+	ofParameter<float> depthRange; // raw depth to 0..1, 14.5 puts 4.5 m of 16 bit millimeters at white
+	ofParameter<float> offsetX; // camera, fraction of the output width
+	ofParameter<float> offsetY; // camera, fraction of the output height
+	ofParameter<float> scale; // camera, 1 = same size as the depth
+
+	ofxDualSource() : depth(NULL), camera(NULL), opened(false), width(1280), height(720) {
+		parameters.setName("kinect + psEye");
+		parameters.add(depthWeight.set("Depth weight", 0.5, 0, 1));
+		parameters.add(cameraWeight.set("Camera weight", 0.5, 0, 1));
+		parameters.add(depthRange.set("Depth range", 14.5, 1, 64));
+		parameters.add(offsetX.set("Camera x", 0, -0.5, 0.5));
+		parameters.add(offsetY.set("Camera y", 0, -0.5, 0.5));
+		parameters.add(scale.set("Camera scale", 1, 0.25, 2));
+	}
+
+	string getName() const { return "kinect + ps3eye"; }
+
+	// output size, takes effect on the next open()
+	void setup(int _width, int _height) {
+		width = _width;
+		height = _height;
+	}
+
+	// The parts to merge. _getDepthTexture picks what of the depth source is merged (e.g. the users-only
+	// depth), by default its texture
+	void setSources(ofxFrameSource& _depth, ofxFrameSource& _camera, std::function<ofTexture&()> _getDepthTexture = nullptr) {
+		depth = &_depth;
+		camera = &_camera;
+		getDepthTexture = _getDepthTexture;
+	}
+
+	// The parts have to be open already
+	bool open() {
+		if (!depth || !camera || !depth->isOpen() || !camera->isOpen())
+			return false;
+		if (!mergeFbo.isAllocated() || mergeFbo.getWidth() != width || mergeFbo.getHeight() != height) {
+			mergeFbo.allocate(width, height, GL_RGB);
+			mergeFbo.black();
+		}
+		opened = true;
+		return true;
+	}
+
+	// leaves the parts open, the source manager parks them once nothing uses them
+	void close() { opened = false; }
+
+	bool isOpen() const { return opened && depth->isOpen() && camera->isOpen(); }
+
+	bool contains(const ofxFrameSource& source) const { return &source == this || &source == depth || &source == camera; }
+
+	// The parts record themselves only if both can, otherwise the merge is recorded
+	bool setRecorder(ofxSessionRecorder* recorder) {
+		if (!depth || !camera)
+			return false;
+		if (depth->setRecorder(recorder) && camera->setRecorder(recorder))
+			return true;
+		depth->setRecorder(NULL);
+		camera->setRecorder(NULL);
+		return false;
+	}
+
+	// Returns true if either part had a new frame. Merges only once both have one
+	bool update() {
+		if (!isOpen())
+			return false;
+		bool isNewDepth = depth->update();
+		bool isNewCamera = camera->update();
+		if (!(isNewDepth || isNewCamera) || !depth->getFrameSequence() || !camera->getFrameSequence())
+			return false;
+
+		ofTexture& depthTexture = getDepthTexture ? getDepthTexture() : depth->getTexture();
+		ofTexture& cameraTexture = camera->getTexture();
+		if (!depthTexture.isAllocated() || !cameraTexture.isAllocated())
+			return false;
+
+		ofRectangle rect(offsetX * width, offsetY * height, width * scale, height * scale);
+		mergeShader.update(mergeFbo, depthTexture, cameraTexture, rect, depthRange, depthWeight, cameraWeight);
+		frameSequence++;
+		// the newest capture in the merge
+		frameTime = MAX(depth->getFrameTime(), camera->getFrameTime());
+		return true;
+	}
+
+	ofTexture& getTexture() { return mergeFbo.getTexture(); }
+};
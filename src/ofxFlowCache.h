@@ -0,0 +1,320 @@
+//
+//  ofxFlowCache.h
+//  visionquest
+//
+//  The optical flow of looping video clips, computed once and kept on disk. The first pass through a clip
+//  computes the flow as usual and stores every frame's fields, later passes load them and skip the optical
+//  flow pass. Files are in cache/flow, one per clip and flow settings:
+//
+//  header | record 0 | record 1 | ... | record frames - 1
+//
+//  Records are fixed size at fixed offsets, so a frame is a single read (or a pointer into a mapped file). A
+//  record is a RecordHeader, the flow and then the decayed flow, each width * height signed 8 bit RG pairs
+//  scaled by the largest component of the frame. A record that was never written is all zeros.
+//  Readbacks go through the pixel buffers of an ofxReadbackRing and are written a frame or two later, never
+//  waiting on the gpu.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ofxTextureUploader.h"
+#include "ofxAssetCache.h"
+#include "ofxReadbackRing.h"
+
+class ofxFlowCache {
+	static const uint32_t VERSION = 1;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t frames;
+		uint32_t reserved;
+		uint64_t key;
+	};
+
+	struct RecordHeader {
+		uint32_t valid;
+		float flowScale;
+		float decayScale;
+		uint32_t reserved;
+	};
+
+	struct Readback : ofxFencedReadback {
+		ofBufferObject flowBuffer;
+		ofBufferObject decayBuffer;
+		int frame;
+		uint64_t key; // of the file it goes to
+	};
+
+	int width;
+	int height;
+	string clipPath;
+	string clipSettings;
+	std::map<string, uint64_t> contentHashes; // per clip path
+	uint64_t key;
+	FILE* file;
+	int frames;
+	vector<bool> cached;
+	int cachedCount;
+
+	flowTools::ftFbo stagingFbos[2]; // the fields in a known format for the readback
+	ofxReadbackRing<Readback> ring;
+
+	vector<int8_t> quantized;
+	vector<float> values;
+	ofTexture flowTexture;
+	ofTexture decayTexture;
+	ofxTextureUploader flowUploader;
+	ofxTextureUploader decayUploader;
+
+	// FNV-1a of the size and three 1 MB samples of the file, enough to tell re-encoded clips apart without
+	// reading gigabytes at every clip change
+	static uint64_t hashContent(const string& path) {
+		uint64_t h = ofxAssetCache::HASH_SEED;
+		FILE* f = fopen(ofToDataPath(path, true).c_str(), "rb");
+		if (!f)
+			return h;
+		const size_t SAMPLE = 1 << 20;
+		seek(f, 0, SEEK_END);
+		uint64_t size = tell(f);
+		ofxAssetCache::hash(h, &size, sizeof(size));
+		vector<uint8_t> buffer(SAMPLE);
+		uint64_t offsets[3] = { 0, size / 2, size > SAMPLE ? size - SAMPLE : 0 };
+		for (int i = 0; i < 3; i++) {
+			seek(f, offsets[i], SEEK_SET);
+			size_t read = fread(buffer.data(), 1, SAMPLE, f);
+			ofxAssetCache::hash(h, buffer.data(), read);
+		}
+		fclose(f);
+		return h;
+	}
+
+	// cache files go past 2 GB for long clips
+	static int seek(FILE* f, uint64_t offset, int origin) {
+#ifdef _WIN32
+		return _fseeki64(f, offset, origin);
+#else
+		return fseeko(f, offset, origin);
+#endif
+	}
+
+	static uint64_t tell(FILE* f) {
+#ifdef _WIN32
+		return _ftelli64(f);
+#else
+		return ftello(f);
+#endif
+	}
+
+	size_t getRecordSize() const { return sizeof(RecordHeader) + 4 * width * height; }
+	uint64_t getRecordOffset(int frame) const { return sizeof(Header) + (uint64_t)frame * getRecordSize(); }
+
+	void closeFile() {
+		if (file)
+			fclose(file);
+		file = NULL;
+		frames = 0;
+		cached.clear();
+		cachedCount = 0;
+		cachedFramesReadout = 0;
+	}
+
+	void openFile(int _frames) {
+		closeFile();
+		if (_frames <= 0)
+			return;
+		char name[32];
+		snprintf(name, sizeof(name), "-%016llx.vqf", (unsigned long long)key);
+		ofDirectory::createDirectory("cache/flow", true, true);
+		string path = ofToDataPath("cache/flow/" + ofFilePath::getBaseName(clipPath) + name, true);
+
+		Header header;
+		file = fopen(path.c_str(), "r+b");
+		if (file) {
+			bool matches = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "VQFC", 4) == 0 &&
+				header.version == VERSION && header.key == key && (int)header.width == width && (int)header.height == height &&
+				(int)header.frames == _frames;
+			if (!matches) {
+				fclose(file);
+				file = NULL;
+			}
+		}
+		if (!file) {
+			file = fopen(path.c_str(), "w+b");
+			if (!file) {
+				ofLogError("ofxFlowCache") << "can't create " << path;
+				return;
+			}
+			memcpy(header.magic, "VQFC", 4);
+			header.version = VERSION;
+			header.width = width;
+			header.height = height;
+			header.frames = _frames;
+			header.reserved = 0;
+			header.key = key;
+			fwrite(&header, sizeof(header), 1, file);
+			// the records read as never written until they are
+			uint8_t zero = 0;
+			seek(file, getRecordOffset(_frames) - 1, SEEK_SET);
+			fwrite(&zero, 1, 1, file);
+			fflush(file);
+		}
+
+		frames = _frames;
+		cached.assign(frames, false);
+		RecordHeader record;
+		for (int i = 0; i < frames; i++) {
+			seek(file, getRecordOffset(i), SEEK_SET);
+			if (fread(&record, sizeof(record), 1, file) == 1 && record.valid) {
+				cached[i] = true;
+				cachedCount++;
+			}
+		}
+		cachedFramesReadout = frames > 0 ? (float)cachedCount / frames : 0;
+		ofLogNotice("ofxFlowCache") << path << ": " << cachedCount << " of " << frames << " frames cached";
+	}
+
+	static float quantize(const float* src, int8_t* dst, int count) {
+		float scale = 0;
+		for (int i = 0; i < count; i++) {
+			scale = MAX(scale, fabs(src[i]));
+		}
+		float factor = scale > 0 ? 127 / scale : 0;
+		for (int i = 0; i < count; i++) {
+			dst[i] = (int8_t)roundf(src[i] * factor);
+		}
+		return scale;
+	}
+
+	void write(Readback& readback) {
+		int count = 2 * width * height;
+		quantized.resize(2 * count);
+		RecordHeader record;
+		record.valid = 1;
+		record.reserved = 0;
+		const float* flow = (const float*)readback.flowBuffer.map(GL_READ_ONLY);
+		if (!flow)
+			return;
+		record.flowScale = quantize(flow, quantized.data(), count);
+		readback.flowBuffer.unmap();
+		const float* decay = (const float*)readback.decayBuffer.map(GL_READ_ONLY);
+		if (!decay)
+			return;
+		record.decayScale = quantize(decay, quantized.data() + count, count);
+		readback.decayBuffer.unmap();
+		seek(file, getRecordOffset(readback.frame), SEEK_SET);
+		fwrite(&record, sizeof(record), 1, file);
+		fwrite(quantized.data(), 1, quantized.size(), file);
+		cached[readback.frame] = true;
+		cachedCount++;
+		cachedFramesReadout = (float)cachedCount / frames;
+	}
+
+public:
+	ofParameterGroup parameters;
+	ofParameter<bool> enabled;
+	ofParameter<float> cachedFramesReadout; // of the current clip
+
+	ofxFlowCache() : width(0), height(0), key(0), file(NULL), frames(0), cachedCount(0) {
+		parameters.setName("flow cache");
+		parameters.add(enabled.set("Cache video flow", false));
+		parameters.add(cachedFramesReadout.set("Cached", 0, 0, 1));
+		cachedFramesReadout.setSerializable(false);
+	}
+	~ofxFlowCache() { closeFile(); }
+
+	void setup(int _width, int _height) {
+		width = _width;
+		height = _height;
+		for (int i = 0; i < 2; i++) {
+			stagingFbos[i].allocate(width, height, GL_RG32F);
+		}
+		flowTexture.allocate(width, height, GL_RG32F);
+		decayTexture.allocate(width, height, GL_RG32F);
+		for (int i = 0; i < ring.size(); i++) {
+			ring[i].flowBuffer.allocate(width * height * 2 * sizeof(float), GL_STREAM_READ);
+			ring[i].decayBuffer.allocate(width * height * 2 * sizeof(float), GL_STREAM_READ);
+		}
+		values.resize(2 * width * height);
+	}
+
+	// The clip the next frames are from and everything else the flow depends on. Cheap when nothing changed
+	void setClip(const string& _path, int _frames, const string& _settings) {
+		if (_path == clipPath && _settings == clipSettings && _frames == frames && (file || _frames <= 0))
+			return;
+		if (_path != clipPath && !contentHashes.count(_path)) {
+			contentHashes[_path] = hashContent(_path);
+		}
+		clipPath = _path;
+		clipSettings = _settings;
+		key = contentHashes[_path];
+		ofxAssetCache::hash(key, &width, sizeof(width));
+		ofxAssetCache::hash(key, &height, sizeof(height));
+		ofxAssetCache::hash(key, clipSettings.data(), clipSettings.size());
+		openFile(_frames);
+	}
+
+	// Loads the fields of a frame of the clip into getFlow() and getFlowDecay(), false if it isn't cached yet
+	bool load(int _frame) {
+		if (!enabled || !file || _frame < 0 || _frame >= frames || !cached[_frame])
+			return false;
+		int count = 2 * width * height;
+		quantized.resize(2 * count);
+		RecordHeader record;
+		seek(file, getRecordOffset(_frame), SEEK_SET);
+		if (fread(&record, sizeof(record), 1, file) != 1 || fread(quantized.data(), 1, quantized.size(), file) != quantized.size())
+			return false;
+		float scales[2] = { record.flowScale / 127, record.decayScale / 127 };
+		ofTexture* textures[2] = { &flowTexture, &decayTexture };
+		ofxTextureUploader* uploaders[2] = { &flowUploader, &decayUploader };
+		for (int field = 0; field < 2; field++) {
+			const int8_t* src = quantized.data() + field * count;
+			for (int i = 0; i < count; i++) {
+				values[i] = src[i] * scales[field];
+			}
+			uploaders[field]->upload(*textures[field], values.data(), width, height, 2 * sizeof(float), GL_RG, GL_FLOAT);
+		}
+		return true;
+	}
+
+	// Queues the fields just computed for a frame of the clip to be written
+	void store(int _frame, ofTexture& _flow, ofTexture& _flowDecay) {
+		if (!enabled || !file || _frame < 0 || _frame >= frames || cached[_frame])
+			return;
+		// skipped while the gpu is far behind, the frame is cached on another pass
+		Readback* readback = ring.push();
+		if (!readback)
+			return;
+		ofPushStyle();
+		ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+		ofTexture* fields[2] = { &_flow, &_flowDecay };
+		for (int i = 0; i < 2; i++) {
+			stagingFbos[i].begin();
+			fields[i]->draw(0, 0, width, height);
+			stagingFbos[i].end();
+		}
+		ofPopStyle();
+		stagingFbos[0].getTexture().copyTo(readback->flowBuffer);
+		stagingFbos[1].getTexture().copyTo(readback->decayBuffer);
+		readback->setFence();
+		readback->frame = _frame;
+		readback->key = key;
+	}
+
+	// Once per app frame, writes the readbacks the gpu is done with
+	void update() {
+		ring.collect([this](Readback& readback) {
+			// dropped if the clip or the settings changed in the meantime
+			if (file && readback.key == key && !cached[readback.frame]) {
+				write(readback);
+			}
+		});
+	}
+
+	ofTexture& getFlow() { return flowTexture; }
+	ofTexture& getFlowDecay() { return decayTexture; }
+};
@@ -0,0 +1,174 @@
+//
+//  ofxFrameSource.h
+//  visionquest
+//
+//  Common interface of the camera / video inputs. A source captures and converts on its own thread and
+//  hands the newest frame to the render thread through a triple buffer, so update() never waits on I/O:
+//  it either picks up a finished frame (and uploads it) or returns false right away.
+//
+
+#pragma once
+
+#include <chrono>
+#include "ofMain.h"
+#include "ofxTextureUploader.h"
+
+// A captured frame, converted and ready to upload
+struct ofxSourceFrame {
+	ofPixels		pixels;			// 8 bit frames (color, gray or raw bayer)
+	ofShortPixels	depth;			// 16 bit depth
+	ofPixels		bodyIndex;		// body index of every depth pixel, 255 is background
+	int				bodyCount;
+	int				trackedBodies;
+	uint64_t		sequence;		// increments with every captured frame
+	double			captureTime;	// ofxFrameSource::now() seconds
+
+	ofxSourceFrame() : bodyCount(0), trackedBodies(0), sequence(0), captureTime(0) {}
+};
+
+// Lock-light handoff between one producer and one consumer thread. The producer always has a buffer to
+// write to and the consumer always gets the newest complete one. Older frames are dropped, never queued.
+template<typename T>
+class ofxTripleBuffer {
+	T			buffers[3];
+	int			front;
+	int			middle;
+	int			back;
+	bool		fresh;
+	std::mutex	mutex;
+
+public:
+	ofxTripleBuffer() : front(0), middle(1), back(2), fresh(false) {}
+
+	// producer side
+	T& getBack() { return buffers[back]; }
+	void publish() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::swap(back, middle);
+		fresh = true;
+	}
+
+	// consumer side, returns false if nothing new was published since the last call
+	bool acquire() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!fresh)
+			return false;
+		std::swap(front, middle);
+		fresh = false;
+		return true;
+	}
+	T& getFront() { return buffers[front]; }
+};
+
+class ofxSessionRecorder;
+
+class ofxFrameSource {
+public:
+	ofxFrameSource() : frameSequence(0), frameTime(0) {}
+	virtual ~ofxFrameSource() {}
+
+	virtual string getName() const = 0;
+	virtual bool open() = 0;
+	virtual void close() = 0;
+	virtual bool isOpen() const = 0;
+
+	// Render thread. Picks up the newest frame if there is one, returns true if getTexture() changed
+	virtual bool update() = 0;
+	virtual ofTexture& getTexture() = 0;
+
+	// True for this source and for any source it is made of, see ofxDualSource
+	virtual bool contains(const ofxFrameSource& source) const { return &source == this; }
+
+	// Sources that record their raw frames into the session themselves (on their capture thread, before any
+	// conversion) keep the recorder and return true, NULL stops them. The frames of every other source are
+	// recorded as they are handed to the processing chain, see ofxSourceManager::record()
+	virtual bool setRecorder(ofxSessionRecorder* recorder) { return false; }
+
+	// sequence number and capture time of the frame in getTexture()
+	uint64_t getFrameSequence() const { return frameSequence; }
+	double getFrameTime() const { return frameTime; }
+
+	// Clock of all capture times. Same clock as PS3EYECam::getTime()
+	static double now() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+protected:
+	uint64_t	frameSequence;
+	double		frameTime;
+};
+
+// A source with a capture thread. Implementations fill in captureFrame() (capture thread) and
+// optionally uploadFrame() (render thread)
+class ofxThreadedFrameSource : public ofxFrameSource, protected ofThread {
+public:
+	ofxThreadedFrameSource() : opened(false), capturedFrames(0) {}
+	virtual ~ofxThreadedFrameSource() {}
+
+	bool open() {
+		if (opened)
+			return true;
+		if (!openDevice())
+			return false;
+		opened = true;
+		startThread();
+		return true;
+	}
+
+	void close() {
+		if (!opened)
+			return;
+		// captureFrame() may block until the next frame, the device has to keep running until the thread is out
+		waitForThread(true);
+		closeDevice();
+		opened = false;
+	}
+
+	bool isOpen() const { return opened; }
+
+	bool update() {
+		if (!opened || !buffers.acquire())
+			return false;
+		ofxSourceFrame& frame = buffers.getFront();
+		uploadFrame(frame);
+		frameSequence = frame.sequence;
+		frameTime = frame.captureTime;
+		return true;
+	}
+
+	ofTexture& getTexture() { return texture; }
+
+protected:
+	// render thread
+	virtual bool openDevice() = 0;
+	virtual void closeDevice() = 0;
+	// capture thread. Wait for the next frame and fill it in, return false if there was none
+	virtual bool captureFrame(ofxSourceFrame& frame) = 0;
+	// render thread. Uploads the 8 bit pixels by default
+	virtual void uploadFrame(ofxSourceFrame& frame) {
+		if (!frame.pixels.isAllocated())
+			return;
+		if (!texture.isAllocated() || texture.getWidth() != frame.pixels.getWidth() || texture.getHeight() != frame.pixels.getHeight()) {
+			texture.allocate(frame.pixels);
+		}
+		uploader.upload(texture, frame.pixels);
+	}
+
+	void threadedFunction() {
+		while (isThreadRunning()) {
+			ofxSourceFrame& frame = buffers.getBack();
+			if (captureFrame(frame)) {
+				frame.sequence = ++capturedFrames;
+				buffers.publish();
+			}
+		}
+	}
+
+	ofTexture						texture;
+	ofxTextureUploader				uploader; // for texture
+	ofxTripleBuffer<ofxSourceFrame>	buffers;
+
+private:
+	bool		opened;
+	uint64_t	capturedFrames;
+};
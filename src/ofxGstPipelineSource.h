@@ -0,0 +1,192 @@
+//
+//  ofxGstPipelineSource.h
+//  visionquest
+//
+//  Any GStreamer pipeline as an ofxFrameSource (Linux). The pipeline description is used as in gst-launch,
+//  e.g. "v4l2src device=/dev/video0", "videotestsrc is-live=true pattern=ball", "rtspsrc location=... ! decodebin"
+//  and gets "! videoconvert ! appsink" appended unless it has its own RGBA appsink named ofxsink.
+//  GStreamer's own streaming threads capture and convert, the appsink keeps a bounded queue that drops the
+//  oldest frames and update() maps the newest sample and copies it straight into the upload ring (see
+//  ofxTextureUploader), without a detour through ofPixels.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxFrameSource.h"
+
+#ifdef TARGET_LINUX
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+
+class ofxGstPipelineSource : public ofxFrameSource {
+	static const int QUEUE_SIZE = 2; // samples the appsink keeps before dropping the oldest
+
+	string description;
+	GstElement* pipeline;
+	GstAppSink* sink;
+
+	ofTexture texture;
+	ofxTextureUploader uploader;
+	int width;
+	int height;
+
+	void upload(const uint8_t* src, int _width, int _height, int stride) {
+		if (_width != width || _height != height) {
+			texture.allocate(_width, _height, GL_RGBA8);
+			width = _width;
+			height = _height;
+		}
+		uploader.upload(texture, src, _width, _height, 4, GL_RGBA, GL_UNSIGNED_BYTE, stride);
+	}
+
+	// the buffer's running time against the pipeline clock says how long ago it was captured
+	double getCaptureTime(GstSample* sample) {
+		double time = now();
+		GstBuffer* buffer = gst_sample_get_buffer(sample);
+		GstSegment* segment = gst_sample_get_segment(sample);
+		GstClock* clock = gst_element_get_clock(pipeline);
+		if (clock && segment && GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer))) {
+			GstClockTime bufferTime = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+			GstClockTime clockTime = gst_clock_get_time(clock) - gst_element_get_base_time(pipeline);
+			if (GST_CLOCK_TIME_IS_VALID(bufferTime) && clockTime > bufferTime) {
+				time -= (double)(clockTime - bufferTime) / GST_SECOND;
+			}
+		}
+		if (clock)
+			gst_object_unref(clock);
+		return time;
+	}
+
+	// restarts finished file pipelines, closes on errors so the app moves on
+	void checkBus() {
+		GstBus* bus = gst_element_get_bus(pipeline);
+		GstMessage* message;
+		while (pipeline && (message = gst_bus_pop_filtered(bus, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS)))) {
+			if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS) {
+				gst_element_seek_simple(pipeline, GST_FORMAT_TIME, (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT), 0);
+			}
+			else {
+				GError* error = NULL;
+				gst_message_parse_error(message, &error, NULL);
+				ofLogError("ofxGstPipelineSource") << (error ? error->message : "pipeline error");
+				if (error)
+					g_error_free(error);
+				gst_message_unref(message);
+				gst_object_unref(bus);
+				close();
+				return;
+			}
+			gst_message_unref(message);
+		}
+		gst_object_unref(bus);
+	}
+
+public:
+	ofxGstPipelineSource() : description("videotestsrc is-live=true"), pipeline(NULL), sink(NULL), width(0), height(0) {}
+	~ofxGstPipelineSource() { close(); }
+
+	string getName() const { return "gstreamer"; }
+
+	// takes effect on the next open()
+	void setup(const string& _description) { description = _description; }
+	const string& getDescription() const { return description; }
+
+	bool open() {
+		if (pipeline)
+			return true;
+		if (!gst_is_initialized()) {
+			gst_init(NULL, NULL);
+		}
+
+		string launch = description;
+		if (launch.find("name=ofxsink") == string::npos) {
+			launch += " ! videoconvert ! video/x-raw,format=RGBA ! appsink name=ofxsink";
+		}
+		GError* error = NULL;
+		pipeline = gst_parse_launch(launch.c_str(), &error);
+		if (error) {
+			ofLogError("ofxGstPipelineSource") << "can't parse \"" << launch << "\": " << error->message;
+			g_error_free(error);
+			if (pipeline)
+				gst_object_unref(pipeline);
+			pipeline = NULL;
+			return false;
+		}
+
+		GstElement* element = gst_bin_get_by_name(GST_BIN(pipeline), "ofxsink");
+		if (!element) {
+			ofLogError("ofxGstPipelineSource") << "no appsink named ofxsink in \"" << launch << "\"";
+			gst_object_unref(pipeline);
+			pipeline = NULL;
+			return false;
+		}
+		sink = GST_APP_SINK(element);
+		gst_app_sink_set_max_buffers(sink, QUEUE_SIZE);
+		gst_app_sink_set_drop(sink, TRUE);
+
+		GstStateChangeReturn result = gst_element_set_state(pipeline, GST_STATE_PLAYING);
+		if (result == GST_STATE_CHANGE_FAILURE) {
+			ofLogError("ofxGstPipelineSource") << "can't start \"" << launch << "\"";
+			close();
+			return false;
+		}
+		// live sources should not be held back by clock sync, files still play at their own rate
+		if (result == GST_STATE_CHANGE_NO_PREROLL) {
+			g_object_set(element, "sync", FALSE, NULL);
+		}
+		return true;
+	}
+
+	void close() {
+		if (!pipeline)
+			return;
+		gst_element_set_state(pipeline, GST_STATE_NULL);
+		if (sink)
+			gst_object_unref(sink);
+		gst_object_unref(pipeline);
+		sink = NULL;
+		pipeline = NULL;
+	}
+
+	bool isOpen() const { return pipeline != NULL; }
+
+	bool update() {
+		if (!pipeline)
+			return false;
+		checkBus();
+		if (!pipeline)
+			return false;
+
+		// only the newest sample matters
+		GstSample* sample = NULL;
+		while (GstSample* newer = gst_app_sink_try_pull_sample(sink, 0)) {
+			if (sample)
+				gst_sample_unref(sample);
+			sample = newer;
+		}
+		if (!sample)
+			return false;
+
+		GstVideoInfo info;
+		GstVideoFrame frame;
+		GstCaps* caps = gst_sample_get_caps(sample);
+		bool mapped = caps && gst_video_info_from_caps(&info, caps) &&
+			gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample), GST_MAP_READ);
+		if (mapped) {
+			upload((const uint8_t*)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0), GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info),
+				GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0));
+			gst_video_frame_unmap(&frame);
+			frameTime = getCaptureTime(sample);
+			frameSequence++;
+		}
+		gst_sample_unref(sample);
+		return mapped;
+	}
+
+	ofTexture& getTexture() { return texture; }
+};
+
+#endif
@@ -0,0 +1,98 @@
+//
+//  ofxKinectSource.h
+//  visionquest
+//
+//  Kinect v2 depth + body index as an ofxFrameSource. The sdk is polled on the capture thread with the
+//  textures of ofxKinectForWindows2 turned off, the pixels are copied there and uploaded on the render thread.
+//  getTexture() is the 16 bit depth, getBodyIndexTexture() the matching body index (255 is background).
+//
+
+#pragma once
+
+#include <atomic>
+#include "ofMain.h"
+#include "ofxKinectForWindows2.h"
+#include "ofxFrameSource.h"
+#include "ofxSessionRecorder.h"
+
+class ofxKinectSource : public ofxThreadedFrameSource {
+	ofxKFW2::Device kinect;
+	ofTexture bodyIndexTexture;
+	ofxTextureUploader bodyIndexUploader;
+	int bodyCount;
+	int trackedBodies;
+	std::atomic<ofxSessionRecorder*> recorder; // read on the capture thread
+
+public:
+	ofxKinectSource() : bodyCount(0), trackedBodies(0), recorder(NULL) {}
+	~ofxKinectSource() { close(); }
+
+	string getName() const { return "kinect"; }
+
+	// depth + body index are recorded while the recorder is recording
+	bool setRecorder(ofxSessionRecorder* _recorder) {
+		recorder = _recorder;
+		return true;
+	}
+
+	ofTexture& getBodyIndexTexture() { return bodyIndexTexture; }
+	// of the current frame
+	int getBodyCount() const { return bodyCount; }
+	int getNumTrackedBodies() const { return trackedBodies; }
+
+protected:
+	bool openDevice() {
+		kinect.open();
+		kinect.initDepthSource();
+		kinect.initBodySource();
+		kinect.initBodyIndexSource();
+		kinect.getDepthSource()->setUseTexture(false);
+		kinect.getBodyIndexSource()->setUseTexture(false);
+		ofLogNotice("ofxKinectSource") << "kinect inited";
+		return true;
+	}
+
+	void closeDevice() {
+		kinect.close();
+	}
+
+	bool captureFrame(ofxSourceFrame& frame) {
+		kinect.update();
+		if (!kinect.getDepthSource()->isFrameNew()) {
+			ofSleepMillis(1);
+			return false;
+		}
+		frame.depth = kinect.getDepthSource()->getPixels();
+		frame.bodyIndex = kinect.getBodyIndexSource()->getPixels();
+		frame.bodyCount = kinect.getBodySource()->getBodyCount();
+
+		const vector<ofxKinectForWindows2::Data::Body>& bodies = kinect.getBodySource()->getBodies();
+		frame.trackedBodies = 0;
+		for (size_t i = 0; i < bodies.size(); i++) {
+			frame.trackedBodies += (bodies[i].tracked ? 1 : 0);
+		}
+		frame.captureTime = now();
+		ofxSessionRecorder* sessionRecorder = recorder;
+		if (sessionRecorder && frame.bodyIndex.isAllocated()) {
+			sessionRecorder->writeDepthFrame(frame.captureTime, frame.depth.getData(), frame.bodyIndex.getData(),
+				frame.depth.getWidth(), frame.depth.getHeight(), frame.bodyCount, frame.trackedBodies);
+		}
+		return true;
+	}
+
+	void uploadFrame(ofxSourceFrame& frame) {
+		if (!texture.isAllocated()) {
+			texture.allocate(frame.depth);
+			texture.setRGToRGBASwizzles(true);
+		}
+		uploader.upload(texture, frame.depth);
+		if (frame.bodyIndex.isAllocated()) {
+			if (!bodyIndexTexture.isAllocated()) {
+				bodyIndexTexture.allocate(frame.bodyIndex);
+			}
+			bodyIndexUploader.upload(bodyIndexTexture, frame.bodyIndex);
+		}
+		bodyCount = frame.bodyCount;
+		trackedBodies = frame.trackedBodies;
+	}
+};
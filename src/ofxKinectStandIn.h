@@ -0,0 +1,63 @@
+//
+//  ofxKinectStandIn.h
+//  visionquest
+//
+//  Takes the place of ofxKinectSource where there is no Kinect v2 (anything but Windows). It loops the depth
+//  frames of a recorded session (see ofxSessionRecorder) in their recorded timing and has the same surface
+//  as the real source: getTexture() is the 16 bit depth, getBodyIndexTexture() the matching body index and
+//  the body counts are the recorded ones. The kinect passes and the people-only autopilot then run, and can
+//  be profiled, on any machine. PS3Eye frames and events in the recording are skipped.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxFrameSource.h"
+#include "ofxSessionSource.h"
+#include "ofxSessionRecorder.h"
+
+class ofxKinectStandIn : public ofxFrameSource {
+	ofxSessionSource session;
+	string path;
+
+public:
+	ofxKinectStandIn() : path("sessions/kinect.vqs") {}
+	~ofxKinectStandIn() { close(); }
+
+	string getName() const { return "kinect"; }
+
+	// a session with depth frames, takes effect on the next open()
+	void setup(const string& _path) { path = _path; }
+
+	// recorded frames aren't recorded again
+	bool setRecorder(ofxSessionRecorder* _recorder) { return true; }
+
+	bool open() {
+		if (session.isOpen())
+			return true;
+		if (!ofFile::doesFileExist(path)) {
+			ofLogError("ofxKinectStandIn") << "no kinect here and no recording at " << path;
+			return false;
+		}
+		session.setup(path);
+		session.setSpeed(1);
+		return session.open();
+	}
+
+	void close() { session.close(); }
+	bool isOpen() const { return session.isOpen(); }
+
+	bool update() {
+		if (!session.update() || !session.isDepthFrame())
+			return false;
+		frameSequence++;
+		frameTime = session.getFrameTime();
+		return true;
+	}
+
+	ofTexture& getTexture() { return session.getDepthTexture(); }
+	ofTexture& getBodyIndexTexture() { return session.getBodyIndexTexture(); }
+	// of the current frame
+	int getBodyCount() const { return session.getBodyCount(); }
+	int getNumTrackedBodies() const { return session.getNumTrackedBodies(); }
+};
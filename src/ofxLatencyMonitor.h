@@ -0,0 +1,232 @@
+//
+//  ofxLatencyMonitor.h
+//  visionquest
+//
+//  Measures how long a source frame takes from capture to the screen. Every new frame is tagged with its
+//  capture time (ofxFrameSource::getFrameTime(), on the ofxFrameSource::now() clock) and the pipeline marks
+//  the end of each stage with a GL timestamp query, so the stages are timed when the gpu finished them and
+//  not when they were submitted. The last stage is queried at the start of the next app frame, after the
+//  buffer swap, which is as close to the photons as GL gets. Queries are read back frames later once they
+//  are available (an ofxReadbackRing of frames), the render never waits on them.
+//  Per stage (time since the previous stage) and total histograms show live in the gui and are logged.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxFrameSource.h"
+#include "ofxReadbackRing.h"
+
+class ofxLatencyMonitor {
+public:
+	enum Stage {
+		STAGE_CAPTURE = 0,
+		STAGE_PICKUP, // the render thread got the frame
+		STAGE_RECOLOR,
+		STAGE_OPTICAL_FLOW,
+		STAGE_FLUID,
+		STAGE_DRAW,
+		STAGE_PRESENT,
+		STAGE_COUNT
+	};
+
+	// 0.5 ms bins up to 250 ms
+	class Histogram {
+		static const int BINS = 500;
+		static constexpr double BIN_SIZE = 0.5;
+		vector<uint32_t> bins;
+		uint32_t count;
+		double maximum;
+
+	public:
+		Histogram() : bins(BINS + 1, 0), count(0), maximum(0) {}
+
+		void add(double ms) {
+			int bin = (int)(MAX(ms, 0.0) / BIN_SIZE);
+			bins[MIN(bin, BINS)]++;
+			count++;
+			maximum = MAX(maximum, ms);
+		}
+
+		void clear() {
+			std::fill(bins.begin(), bins.end(), 0);
+			count = 0;
+			maximum = 0;
+		}
+
+		uint32_t getCount() const { return count; }
+		double getMax() const { return maximum; }
+
+		// upper edge of the bin the percentile falls in
+		double getPercentile(double percentile) const {
+			if (!count)
+				return 0;
+			uint32_t target = (uint32_t)ceil(count * percentile / 100.0);
+			uint32_t sum = 0;
+			for (int i = 0; i <= BINS; i++) {
+				sum += bins[i];
+				if (sum >= target)
+					return i < BINS ? (i + 1) * BIN_SIZE : maximum;
+			}
+			return maximum;
+		}
+
+		string toString() const {
+			if (!count)
+				return "-";
+			return ofToString(getPercentile(50), 1) + " / " + ofToString(getPercentile(95), 1) + " / " + ofToString(getMax(), 1);
+		}
+	};
+
+private:
+	static const int MAX_IN_FLIGHT = 8; // frames whose queries are not read back yet
+
+	struct Record {
+		double times[STAGE_COUNT]; // ofxFrameSource::now() clock
+		GLuint queries[STAGE_COUNT];
+		bool queried[STAGE_COUNT];
+		double gpuOffset; // host minus gpu time, seconds
+
+		// once presented, every earlier query of the frame is done too
+		bool isDone() {
+			GLint available = 0;
+			glGetQueryObjectiv(queries[STAGE_PRESENT], GL_QUERY_RESULT_AVAILABLE, &available);
+			return available != 0;
+		}
+	};
+
+	ofxReadbackRing<Record, MAX_IN_FLIGHT> records;
+	bool open; // the newest record still takes marks
+	bool initialized;
+
+	Histogram histograms[STAGE_COUNT]; // time since the previous stage, STAGE_CAPTURE holds the total
+	float lastLogTime;
+	float lastReadoutTime;
+
+	static const char* getStageName(int stage) {
+		static const char* names[STAGE_COUNT] = { "total", "pickup", "recolor", "optical flow", "fluid", "draw", "present" };
+		return names[stage];
+	}
+
+	void initialize() {
+		for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+			glGenQueries(STAGE_COUNT, records[i].queries);
+		}
+		initialized = true;
+	}
+
+	// reads back the oldest frames whose present query is done
+	void collect() {
+		records.collect([this](Record& record) { addRecord(record); });
+	}
+
+	void addRecord(Record& record) {
+		for (int stage = STAGE_RECOLOR; stage < STAGE_COUNT; stage++) {
+			if (record.queried[stage]) {
+				GLuint64 gpuTime = 0;
+				glGetQueryObjectui64v(record.queries[stage], GL_QUERY_RESULT, &gpuTime);
+				record.times[stage] = gpuTime * 1e-9 + record.gpuOffset;
+			}
+		}
+		// skipped stages (no optical flow without a new frame etc.) count towards the next one
+		double previous = record.times[STAGE_CAPTURE];
+		for (int stage = STAGE_PICKUP; stage < STAGE_COUNT; stage++) {
+			if (stage == STAGE_PICKUP || record.queried[stage]) {
+				histograms[stage].add((record.times[stage] - previous) * 1000);
+				previous = record.times[stage];
+			}
+		}
+		histograms[STAGE_CAPTURE].add((record.times[STAGE_PRESENT] - record.times[STAGE_CAPTURE]) * 1000);
+	}
+
+public:
+	ofParameterGroup parameters;
+	ofParameter<bool> enabled;
+	ofParameter<float> logInterval; // seconds, 0 never logs
+	ofParameter<string> readouts[STAGE_COUNT]; // p50 / p95 / max ms
+
+	ofxLatencyMonitor() : open(false), initialized(false), lastLogTime(0), lastReadoutTime(0) {}
+
+	void setup() {
+		parameters.setName("latency (p50 / p95 / max ms)");
+		parameters.add(enabled.set("Measure latency", false));
+		parameters.add(logInterval.set("Log every (sec)", 10, 0, 60));
+		// pipeline order, total last
+		for (int i = 1; i <= STAGE_COUNT; i++) {
+			int stage = i % STAGE_COUNT;
+			parameters.add(readouts[stage].set(getStageName(stage), "-"));
+			readouts[stage].setSerializable(false);
+		}
+	}
+
+	// Once per app frame before anything else is drawn: marks the previous frame presented and collects
+	void update() {
+		if (!enabled) {
+			records.clear();
+			open = false;
+			return;
+		}
+		if (!initialized) {
+			initialize();
+		}
+		if (open) {
+			mark(STAGE_PRESENT);
+			open = false;
+		}
+		collect();
+
+		float time = ofGetElapsedTimef();
+		if (time - lastReadoutTime > 0.5) {
+			for (int stage = 0; stage < STAGE_COUNT; stage++) {
+				readouts[stage].set(histograms[stage].toString());
+			}
+			lastReadoutTime = time;
+		}
+		if (logInterval > 0 && time - lastLogTime > logInterval) {
+			if (histograms[STAGE_CAPTURE].getCount()) {
+				ofLog log(OF_LOG_NOTICE, "latency");
+				log << histograms[STAGE_CAPTURE].getCount() << " frames, p50 / p95 / max ms:";
+				for (int stage = 0; stage < STAGE_COUNT; stage++) {
+					log << " " << getStageName(stage) << " " << histograms[stage].toString() << ",";
+				}
+			}
+			for (int stage = 0; stage < STAGE_COUNT; stage++) {
+				histograms[stage].clear();
+			}
+			lastLogTime = time;
+		}
+	}
+
+	// A new source frame was picked up
+	void beginFrame(double captureTime) {
+		if (!enabled || !initialized)
+			return;
+		if (open) {
+			// a second frame in the same app frame, the first one never reaches the screen on its own
+			records.popNewest();
+			open = false;
+		}
+		Record* newest = records.push();
+		if (!newest)
+			return;
+		open = true;
+		Record& record = *newest;
+		std::fill(record.queried, record.queried + STAGE_COUNT, false);
+		record.times[STAGE_CAPTURE] = captureTime;
+		record.times[STAGE_PICKUP] = ofxFrameSource::now();
+		GLint64 gpuTime = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+		record.gpuOffset = ofxFrameSource::now() - gpuTime * 1e-9;
+	}
+
+	// After the gl calls of the stage are submitted
+	void mark(Stage stage) {
+		if (!enabled || !open)
+			return;
+		Record& record = records.getNewest();
+		glQueryCounter(record.queries[stage], GL_TIMESTAMP);
+		record.queried[stage] = true;
+	}
+
+	const Histogram& getHistogram(Stage stage) const { return histograms[stage]; }
+};
@@ -0,0 +1,187 @@
+//
+//  ofxOfflineRender.h
+//  visionquest
+//
+//  Writes the frames of an offline render to numbered image files. Every frame is copied out of the fbo
+//  into a pixel buffer object and only mapped one frame later, when the gpu is done with it, so the
+//  readback never stalls the render. A few writer threads encode and save the images. Unlike the live
+//  sources nothing is ever dropped: when the writers fall behind, addFrame() waits for them.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include "ofMain.h"
+
+class ofxOfflineRender {
+public:
+	struct Settings {
+		string input; // session (.vqs), video file or folder of videos
+		string output;
+		float fps;
+		float duration; // seconds, 0 renders the input once
+		string format; // image extension
+		Settings() : output("renders"), fps(60), duration(0), format("png") {}
+	};
+
+private:
+	static const int MAX_QUEUED_FRAMES = 16;
+
+	struct Frame {
+		ofPixels pixels;
+		uint64_t index;
+	};
+
+	class Writer : public ofThread {
+	public:
+		ofxOfflineRender* render;
+		void threadedFunction() { render->write(); }
+	};
+
+	Settings settings;
+	bool enabled;
+	uint64_t frameCount;
+	uint64_t framesWritten;
+	int pending; // pbo holding the previous frame, -1 if none
+	uint64_t pendingIndex;
+
+	ofBufferObject pixelBuffers[2];
+	int width;
+	int height;
+
+	vector<unique_ptr<Writer>> writers;
+	std::deque<Frame*> queue;
+	vector<Frame*> pool;
+	bool stopping;
+	std::mutex queueMutex;
+	std::condition_variable queueReady;
+	std::condition_variable queueSpace;
+
+	// writer threads
+	void write() {
+		while (true) {
+			Frame* frame;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueReady.wait(lock, [this] { return !queue.empty() || stopping; });
+				if (queue.empty())
+					return;
+				frame = queue.front();
+				queue.pop_front();
+			}
+			char name[32];
+			snprintf(name, sizeof(name), "%06llu.", (unsigned long long)frame->index);
+			if (!ofSaveImage(frame->pixels, settings.output + "/" + name + settings.format)) {
+				ofLogError("ofxOfflineRender") << "can't write frame " << frame->index;
+			}
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				pool.push_back(frame);
+				framesWritten++;
+			}
+			queueSpace.notify_one();
+		}
+	}
+
+	// maps the previous frame's pbo and queues its pixels
+	void queuePending() {
+		if (pending < 0)
+			return;
+		Frame* frame;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueSpace.wait(lock, [this] { return (int)queue.size() < MAX_QUEUED_FRAMES; });
+			if (pool.empty()) {
+				frame = new Frame();
+			}
+			else {
+				frame = pool.back();
+				pool.pop_back();
+			}
+		}
+		frame->pixels.allocate(width, height, OF_PIXELS_RGBA);
+		const uint8_t* data = (const uint8_t*)pixelBuffers[pending].map(GL_READ_ONLY);
+		if (data) {
+			memcpy(frame->pixels.getData(), data, frame->pixels.getTotalBytes());
+			pixelBuffers[pending].unmap();
+		}
+		frame->index = pendingIndex;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			queue.push_back(frame);
+		}
+		queueReady.notify_one();
+		pending = -1;
+	}
+
+public:
+	ofxOfflineRender() : enabled(false), frameCount(0), framesWritten(0), pending(-1), pendingIndex(0), width(0), height(0), stopping(false) {}
+	~ofxOfflineRender() {
+		finish();
+		for (size_t i = 0; i < pool.size(); i++) {
+			delete pool[i];
+		}
+	}
+
+	void setup(const Settings& _settings) {
+		settings = _settings;
+		enabled = !settings.input.empty() && settings.fps > 0;
+		if (!enabled)
+			return;
+		ofDirectory::createDirectory(settings.output, true, true);
+		frameCount = 0;
+		framesWritten = 0;
+		stopping = false;
+		// the encoding is the slow part, leave a core for the render
+		int threads = MAX(1, (int)std::thread::hardware_concurrency() - 1);
+		for (int i = 0; i < threads; i++) {
+			writers.push_back(unique_ptr<Writer>(new Writer()));
+			writers.back()->render = this;
+			writers.back()->startThread();
+		}
+		ofLogNotice("ofxOfflineRender") << "rendering " << settings.input << " at " << settings.fps << " fps to " << settings.output;
+	}
+
+	bool isEnabled() const { return enabled; }
+	const Settings& getSettings() const { return settings; }
+	double getStep() const { return 1.0 / settings.fps; }
+	uint64_t getFrameCount() const { return frameCount; }
+
+	// after drawing the frame into fbo
+	void addFrame(ofFbo& fbo) {
+		if (!enabled)
+			return;
+		int current = frameCount % 2;
+		if (width != fbo.getWidth() || height != fbo.getHeight()) {
+			queuePending();
+			width = fbo.getWidth();
+			height = fbo.getHeight();
+			pixelBuffers[0].allocate(width * height * 4, GL_STREAM_READ);
+			pixelBuffers[1].allocate(width * height * 4, GL_STREAM_READ);
+		}
+		fbo.getTexture().copyTo(pixelBuffers[current]);
+		frameCount++;
+		// the previous frame has had a whole frame to arrive
+		queuePending();
+		pending = current;
+		pendingIndex = frameCount - 1;
+	}
+
+	// writes out what is left
+	void finish() {
+		if (!enabled)
+			return;
+		queuePending();
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueReady.notify_all();
+		for (size_t i = 0; i < writers.size(); i++) {
+			writers[i]->waitForThread(false);
+		}
+		writers.clear();
+		ofLogNotice("ofxOfflineRender") << "wrote " << framesWritten << " frames to " << settings.output;
+		enabled = false;
+	}
+};
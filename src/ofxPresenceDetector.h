@@ -0,0 +1,170 @@
+//
+//  ofxPresenceDetector.h
+//  visionquest
+//
+//  Tells whether people are in front of the installation, for any source. The foreground mask of the
+//  frame (the Kinect body index, or the background model's mask for the cameras) is shrunk on the gpu
+//  to a grid of cells holding their foreground fraction. The grid is copied into a pixel buffer of an
+//  ofxReadbackRing and read back frames later, once its fence has passed, so the render never waits on it. The cpu then
+//  has a couple of thousand bytes to look at: the coverage and the number of connected blobs.
+//  Presence has hysteresis: it starts after enough coverage for a while and ends after too little
+//  for a while, so a person stepping through the edge of the frame doesn't flip the autopilot.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ftMaskReduceShader.h"
+#include "ofxReadbackRing.h"
+
+class ofxPresenceDetector {
+	struct Readback : ofxFencedReadback {
+		ofBufferObject buffer;
+		float time; // when the mask was sampled
+	};
+
+	flowTools::ftFbo reduceFbo;
+	flowTools::ftMaskReduceShader reduceShader;
+	ofxReadbackRing<Readback> ring;
+	int width;
+	int height;
+
+	float lastSampleTime;
+	float coverage;
+	int blobCount;
+	bool present;
+	float changeTime; // since when the measurements disagree with present, -1 if they don't
+
+	vector<uint8_t> cells; // foreground cells, reused
+	vector<int> stack;
+
+	// 4-connected groups of foreground cells with at least minBlobCells cells
+	int countBlobs() {
+		int blobs = 0;
+		for (int start = 0; start < width * height; start++) {
+			if (cells[start] != 1)
+				continue;
+			int size = 0;
+			stack.clear();
+			stack.push_back(start);
+			cells[start] = 2;
+			while (!stack.empty()) {
+				int i = stack.back();
+				stack.pop_back();
+				size++;
+				int x = i % width;
+				int y = i / width;
+				int neighbours[4] = { x > 0 ? i - 1 : -1, x < width - 1 ? i + 1 : -1, y > 0 ? i - width : -1, y < height - 1 ? i + width : -1 };
+				for (int n = 0; n < 4; n++) {
+					if (neighbours[n] >= 0 && cells[neighbours[n]] == 1) {
+						cells[neighbours[n]] = 2;
+						stack.push_back(neighbours[n]);
+					}
+				}
+			}
+			if (size >= minBlobCells)
+				blobs++;
+		}
+		return blobs;
+	}
+
+	void measure(const uint8_t* data, float time) {
+		uint32_t sum = 0;
+		uint8_t threshold = (uint8_t)(cellThreshold * 255);
+		for (int i = 0; i < width * height; i++) {
+			sum += data[i];
+			cells[i] = data[i] > threshold ? 1 : 0;
+		}
+		coverage = sum / (255.0f * width * height);
+		blobCount = countBlobs();
+
+		bool seen = present ? coverage >= exitCoverage && blobCount > 0 : coverage >= enterCoverage && blobCount > 0;
+		if (seen == present) {
+			changeTime = -1;
+		}
+		else if (changeTime < 0) {
+			changeTime = time;
+		}
+		else if (time - changeTime >= (present ? exitDelay : enterDelay)) {
+			present = seen;
+			changeTime = -1;
+			ofLogNotice("ofxPresenceDetector") << (present ? "people arrived" : "everyone left") << ", coverage " << coverage << ", " << blobCount << " blobs";
+		}
+		coverageReadout.set(coverage);
+		blobsReadout.set(blobCount);
+	}
+
+	// maps the samples whose copy is done, oldest first
+	void collect() {
+		ring.collect([this](Readback& readback) {
+			const uint8_t* data = (const uint8_t*)readback.buffer.map(GL_READ_ONLY);
+			if (data) {
+				measure(data, readback.time);
+				readback.buffer.unmap();
+			}
+		});
+	}
+
+public:
+	ofParameterGroup parameters;
+	ofParameter<bool> enabled;
+	ofParameter<float> sampleInterval; // seconds
+	ofParameter<float> cellThreshold; // foreground fraction for a cell to be part of a blob
+	ofParameter<int> minBlobCells;
+	ofParameter<float> enterCoverage;
+	ofParameter<float> exitCoverage;
+	ofParameter<float> enterDelay; // seconds
+	ofParameter<float> exitDelay;
+	ofParameter<float> coverageReadout;
+	ofParameter<int> blobsReadout;
+
+	ofxPresenceDetector() : width(0), height(0), lastSampleTime(-1000), coverage(0), blobCount(0), present(false), changeTime(-1) {}
+
+	// grid size in cells, the width a multiple of 4 for the default pack alignment
+	void setup(int _width = 64, int _height = 36) {
+		width = _width;
+		height = _height;
+		reduceFbo.allocate(width, height, GL_R8);
+		reduceFbo.black();
+		for (int i = 0; i < ring.size(); i++) {
+			ring[i].buffer.allocate(width * height, GL_STREAM_READ);
+		}
+		cells.resize(width * height);
+
+		parameters.setName("presence");
+		parameters.add(enabled.set("Detect presence", true));
+		parameters.add(sampleInterval.set("Sample every (sec)", 0.25, 0, 2));
+		parameters.add(cellThreshold.set("Cell threshold", 0.3, 0.05, 1));
+		parameters.add(minBlobCells.set("Min blob cells", 6, 1, 100));
+		parameters.add(enterCoverage.set("Enter coverage", 0.02, 0, 0.5));
+		parameters.add(exitCoverage.set("Exit coverage", 0.01, 0, 0.5));
+		parameters.add(enterDelay.set("Enter after (sec)", 1, 0, 10));
+		parameters.add(exitDelay.set("Exit after (sec)", 3, 0, 30));
+		parameters.add(coverageReadout.set("Coverage", 0, 0, 1));
+		coverageReadout.setSerializable(false);
+		parameters.add(blobsReadout.set("Blobs", 0, 0, 20));
+		blobsReadout.setSerializable(false);
+	}
+
+	// Once per app frame. _mask is the foreground of a new frame, or NULL if there is none
+	void update(ofTexture* _mask, bool _isBodyIndex, float _time) {
+		if (!enabled || !width)
+			return;
+		collect();
+		if (!_mask || !_mask->isAllocated() || _time - lastSampleTime < sampleInterval)
+			return;
+		Readback* readback = ring.push();
+		if (!readback)
+			return;
+		reduceShader.update(reduceFbo, *_mask, _isBodyIndex);
+		reduceFbo.getTexture().copyTo(readback->buffer);
+		readback->setFence();
+		readback->time = _time;
+		lastSampleTime = _time;
+	}
+
+	bool isPresent() const { return present; }
+	float getCoverage() const { return coverage; }
+	int getBlobCount() const { return blobCount; }
+};
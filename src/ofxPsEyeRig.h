@@ -0,0 +1,281 @@
+//
+//  ofxPsEyeRig.h
+//  visionquest
+//
+//  Several PS3Eye cameras captured concurrently and stitched side by side into one wide source.
+//  Every camera has its own capture thread that only keeps the last few raw YUYV frames with their
+//  timestamps. update() picks one frame per camera closest to a common time (a frame set), uploads
+//  them as is and stitches + converts them in a single GPU pass (ftStitchShader). The rig is an
+//  ofxFrameSource, but it keeps its own per camera threads instead of a single capture thread.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ps3eye.h"
+#include "ftStitchShader.h"
+#include "ofxFrameSource.h"
+
+class ofxPsEyeRig : public ofxFrameSource {
+	static const int MAX_CAMERAS = flowTools::ftStitchShader::MAX_CAMERAS;
+	static const int HISTORY = 4; // frames kept per camera for matching
+
+	class CameraThread : public ofThread {
+	public:
+		ps3eye::PS3EYECam::PS3EYERef eye;
+
+		struct Slot {
+			uint8_t* frame;
+			double timestamp;
+			uint64_t sequence;
+			bool inUse; // being uploaded by the main thread
+		};
+		Slot slots[HISTORY];
+		uint64_t frameCount;
+
+		CameraThread() : frameCount(0) {
+			memset(slots, 0, sizeof(slots));
+		}
+
+		~CameraThread() {
+			for (int i = 0; i < HISTORY; i++) {
+				free(slots[i].frame);
+			}
+		}
+
+		void threadedFunction() {
+			while (isThreadRunning()) {
+				double timestamp;
+				uint8_t* frame = eye->getFrame(&timestamp);
+
+				lock();
+				// overwrite the oldest slot that is not being uploaded
+				int target = -1;
+				for (int i = 0; i < HISTORY; i++) {
+					if (slots[i].inUse)
+						continue;
+					if (target < 0 || slots[i].sequence < slots[target].sequence)
+						target = i;
+				}
+				uint8_t* old = slots[target].frame;
+				slots[target].frame = frame;
+				slots[target].timestamp = timestamp;
+				slots[target].sequence = ++frameCount;
+				unlock();
+
+				free(old);
+			}
+		}
+	};
+
+	vector<shared_ptr<CameraThread> > cameras;
+	vector<ofTexture> yuyvTextures;
+	ofxTextureUploader yuyvUploaders[MAX_CAMERAS];
+	flowTools::ftStitchShader stitchShader;
+	flowTools::ftFbo stitchFbo;
+
+	int width;
+	int height;
+	int cameraWidth;
+	int cameraHeight;
+	int frameRate;
+
+	// evenly spread over the width with a little overlap for the feathering
+	void applyDefaultLayout() {
+		int numCameras = cameras.size();
+		layoutCameras = numCameras;
+		if (numCameras == 0)
+			return;
+		float aspect = (float)cameraWidth / cameraHeight;
+		float cameraScale = MIN(1.0f, 1.1f * width / (numCameras * height * aspect));
+		float cameraFraction = cameraScale * height * aspect / width;
+		for (int i = 0; i < numCameras; i++) {
+			scale[i] = cameraScale;
+			offsetX[i] = numCameras > 1 ? i * (1.0f - cameraFraction) / (numCameras - 1) : (1.0f - cameraFraction) * 0.5f;
+			offsetY[i] = (1.0f - cameraScale) * 0.5f;
+		}
+	}
+
+	void onResetLayout(bool& reset) {
+		if (reset) {
+			resetLayout = false;
+			applyDefaultLayout();
+		}
+	}
+
+public:
+	ofParameterGroup parameters;
+	ofParameter<float> feather; // fraction of the output width
+	ofParameter<float> syncTolerance; // fraction of a frame period
+	ofParameter<float> offsetX[MAX_CAMERAS]; // fraction of the output width
+	ofParameter<float> offsetY[MAX_CAMERAS]; // fraction of the output height
+	ofParameter<float> scale[MAX_CAMERAS]; // 1 = camera height fills the output height
+	ofParameter<int> layoutCameras; // the cameras the layout above is for, 0 until the first open()
+	ofParameter<bool> resetLayout; // back to the default layout, or on the next open() while closed
+
+	ofxPsEyeRig() : width(1280), height(720), cameraWidth(640), cameraHeight(480), frameRate(60) {
+		parameters.setName("psEye rig");
+		parameters.add(feather.set("Feather", 0.05, 0, 0.25));
+		parameters.add(syncTolerance.set("Sync tolerance", 0.5, 0.1, 2));
+		for (int i = 0; i < MAX_CAMERAS; i++) {
+			parameters.add(offsetX[i].set("Cam " + ofToString(i) + " x", 0, -0.5, 1.5));
+			parameters.add(offsetY[i].set("Cam " + ofToString(i) + " y", 0, -0.5, 0.5));
+			parameters.add(scale[i].set("Cam " + ofToString(i) + " scale", 1, 0.1, 2));
+		}
+		parameters.add(layoutCameras.set("Layout cameras", 0, 0, MAX_CAMERAS));
+		parameters.add(resetLayout.set("Reset layout", false));
+		resetLayout.setSerializable(false);
+		resetLayout.addListener(this, &ofxPsEyeRig::onResetLayout);
+	}
+
+	~ofxPsEyeRig() {
+		close();
+	}
+
+	string getName() const { return "ps3eye rig"; }
+
+	// output size and camera frame rate, take effect on the next open()
+	void setup(int _width, int _height, int _frameRate = 60) {
+		width = _width;
+		height = _height;
+		frameRate = _frameRate;
+	}
+
+	// Opens every connected camera (up to MAX_CAMERAS) and lays them out side by side
+	bool open() {
+		close();
+
+		const vector<ps3eye::PS3EYECam::PS3EYERef>& devices = ps3eye::PS3EYECam::getDevices();
+		for (size_t i = 0; i < devices.size() && cameras.size() < MAX_CAMERAS; i++) {
+			ps3eye::PS3EYECam::PS3EYERef eye = devices[i];
+			if (!eye->init(640, 480, frameRate, ps3eye::PS3EYECam::OUTPUT_YUYV)) {
+				ofLogError("ofxPsEyeRig") << "failed to open camera " << i;
+				continue;
+			}
+			eye->start();
+			cameraWidth = eye->getWidth();
+			cameraHeight = eye->getHeight();
+
+			shared_ptr<CameraThread> camera(new CameraThread());
+			camera->eye = eye;
+			camera->startThread();
+			cameras.push_back(camera);
+		}
+
+		yuyvTextures.resize(cameras.size());
+		for (size_t i = 0; i < yuyvTextures.size(); i++) {
+			yuyvTextures[i].allocate(cameraWidth / 2, cameraHeight, GL_RGBA8);
+			yuyvTextures[i].setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+		}
+		stitchFbo.allocate(width, height, GL_RGB);
+		stitchFbo.black();
+
+		// a saved layout is kept as long as it was made for as many cameras
+		int numCameras = cameras.size();
+		if (numCameras > 0 && numCameras != layoutCameras) {
+			applyDefaultLayout();
+		}
+
+		ofLogNotice("ofxPsEyeRig") << "running " << numCameras << " cameras";
+		return numCameras > 0;
+	}
+
+	void close() {
+		// the capture threads block in getFrame() until the next frame, so stop them while the cameras still stream
+		for (size_t i = 0; i < cameras.size(); i++) {
+			cameras[i]->stopThread();
+		}
+		for (size_t i = 0; i < cameras.size(); i++) {
+			cameras[i]->waitForThread(false);
+			cameras[i]->eye->stop();
+		}
+		cameras.clear();
+	}
+
+	bool isOpen() const { return !cameras.empty(); }
+
+	// Matches the newest frames of all cameras into a frame set and stitches it.
+	// Returns true if a new stitched frame is available.
+	bool update() {
+		int numCameras = cameras.size();
+		if (numCameras == 0)
+			return false;
+
+		// the set time is the newest time every camera has reached
+		double setTime = 0;
+		for (int i = 0; i < numCameras; i++) {
+			CameraThread& camera = *cameras[i];
+			double newest = 0;
+			camera.lock();
+			for (int s = 0; s < HISTORY; s++) {
+				if (camera.slots[s].frame && camera.slots[s].timestamp > newest)
+					newest = camera.slots[s].timestamp;
+			}
+			camera.unlock();
+			if (newest == 0)
+				return false;
+			setTime = (i == 0) ? newest : MIN(setTime, newest);
+		}
+		if (setTime <= frameTime)
+			return false;
+
+		// pick each camera's frame closest to the set time and check they belong together
+		double tolerance = syncTolerance / frameRate;
+		int picked[MAX_CAMERAS];
+		for (int i = 0; i < numCameras; i++) {
+			CameraThread& camera = *cameras[i];
+			camera.lock();
+			picked[i] = -1;
+			double best = 0;
+			for (int s = 0; s < HISTORY; s++) {
+				if (!camera.slots[s].frame)
+					continue;
+				double distance = fabs(camera.slots[s].timestamp - setTime);
+				if (picked[i] < 0 || distance < best) {
+					picked[i] = s;
+					best = distance;
+				}
+			}
+			bool inSync = best <= tolerance;
+			if (inSync)
+				camera.slots[picked[i]].inUse = true;
+			camera.unlock();
+
+			if (!inSync) {
+				// release what we already claimed and wait for the next frames
+				for (int j = 0; j < i; j++) {
+					cameras[j]->lock();
+					cameras[j]->slots[picked[j]].inUse = false;
+					cameras[j]->unlock();
+				}
+				return false;
+			}
+		}
+
+		// the claimed slots can't be overwritten by the capture threads, upload without holding the lock
+		for (int i = 0; i < numCameras; i++) {
+			CameraThread& camera = *cameras[i];
+			yuyvUploaders[i].upload(yuyvTextures[i], camera.slots[picked[i]].frame, cameraWidth / 2, cameraHeight, 4, GL_RGBA, GL_UNSIGNED_BYTE);
+			camera.lock();
+			camera.slots[picked[i]].inUse = false;
+			camera.unlock();
+		}
+		frameTime = setTime;
+		frameSequence++;
+
+		vector<ofTexture*> textures;
+		vector<ofRectangle> rects;
+		float aspect = (float)cameraWidth / cameraHeight;
+		for (int i = 0; i < numCameras; i++) {
+			textures.push_back(&yuyvTextures[i]);
+			float height = stitchFbo.getHeight() * scale[i];
+			rects.push_back(ofRectangle(offsetX[i] * stitchFbo.getWidth(), offsetY[i] * stitchFbo.getHeight(), height * aspect, height));
+		}
+		stitchShader.update(stitchFbo, textures, rects, cameraWidth, cameraHeight, feather * stitchFbo.getWidth());
+		return true;
+	}
+
+	ofTexture& getTexture() { return stitchFbo.getTexture(); }
+	int getNumCameras() const { return cameras.size(); }
+};
@@ -0,0 +1,157 @@
+//
+//  ofxPsEyeSource.h
+//  visionquest
+//
+//  A single PS3Eye as an ofxFrameSource. The capture thread waits on the driver, converts YUYV to RGBA
+//  (or passes raw Bayer through untouched) and the render thread only uploads, demosaicing Bayer on the gpu.
+//
+
+#pragma once
+
+#include <atomic>
+#include "ofMain.h"
+#include "ftFbo.h"
+#include "ps3eye.h"
+#include "ofxFrameSource.h"
+#include "ftDebayerShader.h"
+#include "ofxSessionRecorder.h"
+
+class ofxPsEyeSource : public ofxThreadedFrameSource {
+	static const int ITUR_BT_601_CY = 1220542;
+	static const int ITUR_BT_601_CUB = 2116026;
+	static const int ITUR_BT_601_CUG = -409993;
+	static const int ITUR_BT_601_CVG = -852492;
+	static const int ITUR_BT_601_CVR = 1673527;
+	static const int ITUR_BT_601_SHIFT = 20;
+
+	ps3eye::PS3EYECam::PS3EYERef eye;
+	int deviceIndex;
+	bool rawBayer;
+	std::atomic<ofxSessionRecorder*> recorder; // read on the capture thread
+
+	ofTexture bayerTexture; // raw 8 bit frame when the eye runs in bayer mode
+	flowTools::ftFbo bayerFbo;
+	flowTools::ftDebayerShader debayerShader;
+
+	static uint8_t saturate(int v) {
+		return static_cast<uint8_t>(static_cast<uint32_t>(v) <= 0xff ? v : v > 0 ? 0xff : 0);
+	}
+
+	static void yuv422_to_rgba(const uint8_t *yuv_src, const int stride, uint8_t *dst, const int width, const int height) {
+		const int half = 1 << (ITUR_BT_601_SHIFT - 1);
+
+		for (int j = 0; j < height; j++, yuv_src += stride) {
+			uint8_t* row = dst + (width * 4) * j; // 4 channels
+
+			for (int i = 0; i < 2 * width; i += 4, row += 8) {
+				int u = static_cast<int>(yuv_src[i + 1]) - 128;
+				int v = static_cast<int>(yuv_src[i + 3]) - 128;
+
+				int ruv = half + ITUR_BT_601_CVR * v;
+				int guv = half + ITUR_BT_601_CVG * v + ITUR_BT_601_CUG * u;
+				int buv = half + ITUR_BT_601_CUB * u;
+
+				int y00 = MAX(0, static_cast<int>(yuv_src[i]) - 16) * ITUR_BT_601_CY;
+				row[0] = saturate((y00 + ruv) >> ITUR_BT_601_SHIFT);
+				row[1] = saturate((y00 + guv) >> ITUR_BT_601_SHIFT);
+				row[2] = saturate((y00 + buv) >> ITUR_BT_601_SHIFT);
+				row[3] = 0xff;
+
+				int y01 = MAX(0, static_cast<int>(yuv_src[i + 2]) - 16) * ITUR_BT_601_CY;
+				row[4] = saturate((y01 + ruv) >> ITUR_BT_601_SHIFT);
+				row[5] = saturate((y01 + guv) >> ITUR_BT_601_SHIFT);
+				row[6] = saturate((y01 + buv) >> ITUR_BT_601_SHIFT);
+				row[7] = 0xff;
+			}
+		}
+	}
+
+public:
+	ofxPsEyeSource() : deviceIndex(0), rawBayer(false), recorder(NULL) {}
+	~ofxPsEyeSource() { close(); }
+
+	string getName() const { return "ps3eye"; }
+
+	// both take effect on the next open()
+	void setDeviceIndex(int _index) { deviceIndex = _index; }
+	void setRawBayer(bool _rawBayer) { rawBayer = _rawBayer; }
+
+	// raw frames are recorded as they come from the driver while the recorder is recording
+	bool setRecorder(ofxSessionRecorder* _recorder) {
+		recorder = _recorder;
+		return true;
+	}
+
+	int getDeviceIndex() const { return deviceIndex; }
+	bool isRawBayer() const { return eye && eye->getOutputFormat() == ps3eye::PS3EYECam::OUTPUT_BAYER; }
+
+	// for the camera controls, NULL while closed
+	ps3eye::PS3EYECam::PS3EYERef getEye() const { return eye; }
+
+	ofTexture& getTexture() { return isRawBayer() ? bayerFbo.getTexture() : texture; }
+
+protected:
+	bool openDevice() {
+		const vector<ps3eye::PS3EYECam::PS3EYERef>& devices = ps3eye::PS3EYECam::getDevices();
+		if (devices.empty()) {
+			ofLogError("ofxPsEyeSource") << "no PS eye connected";
+			return false;
+		}
+		eye = devices.at(deviceIndex < (int)devices.size() ? deviceIndex : 0);
+		// raw bayer halves the bus load so vga can go above 60 fps
+		bool res = rawBayer ?
+			eye->init(640, 480, 75, ps3eye::PS3EYECam::OUTPUT_BAYER) :
+			eye->init(640, 480, 60, ps3eye::PS3EYECam::OUTPUT_YUYV);
+		if (!res) {
+			ofLogError("ofxPsEyeSource") << "failed to init PS eye " << deviceIndex;
+			eye = NULL;
+			return false;
+		}
+		eye->start();
+
+		if (rawBayer) {
+			bayerTexture.allocate(eye->getWidth(), eye->getHeight(), GL_R8);
+			bayerFbo.allocate(eye->getWidth(), eye->getHeight(), GL_RGB);
+			bayerFbo.black();
+		}
+		return true;
+	}
+
+	void closeDevice() {
+		eye->stop();
+		eye = NULL;
+	}
+
+	bool captureFrame(ofxSourceFrame& frame) {
+		double timestamp;
+		uint8_t* data = eye->getFrame(&timestamp);
+		int width = eye->getWidth();
+		int height = eye->getHeight();
+		ofxSessionRecorder* sessionRecorder = recorder;
+		if (sessionRecorder) {
+			sessionRecorder->writePsEyeFrame(timestamp, data, width, height, eye->getRowBytes(), eye->getOutputFormat());
+		}
+		if (eye->getOutputFormat() == ps3eye::PS3EYECam::OUTPUT_BAYER) {
+			frame.pixels.allocate(width, height, OF_PIXELS_GRAY);
+			memcpy(frame.pixels.getData(), data, width * height);
+		}
+		else {
+			frame.pixels.allocate(width, height, OF_PIXELS_RGBA);
+			yuv422_to_rgba(data, eye->getRowBytes(), frame.pixels.getData(), width, height);
+		}
+		free(data);
+		frame.captureTime = timestamp;
+		return true;
+	}
+
+	void uploadFrame(ofxSourceFrame& frame) {
+		if (frame.pixels.getNumChannels() == 1 && bayerTexture.isAllocated()) {
+			// upload the raw frame as is, the demosaic runs on the gpu
+			uploader.upload(bayerTexture, frame.pixels);
+			debayerShader.update(bayerFbo, bayerTexture);
+		}
+		else {
+			ofxThreadedFrameSource::uploadFrame(frame);
+		}
+	}
+};
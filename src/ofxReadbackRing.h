@@ -0,0 +1,85 @@
+//
+//  ofxReadbackRing.h
+//  visionquest
+//
+//  Results the gpu produces for the cpu (pixel buffer copies, timer queries) read back frames later instead
+//  of waiting for them. Slots are pushed in order and collected oldest first once the gpu is done with them.
+//  When every slot is still in flight the gpu is far behind: push() returns NULL and the new readback is
+//  skipped, the render never waits and older results are never thrown away. A slot type only needs an
+//  isDone() that doesn't block, ofxFencedReadback is the one for buffer copies.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+// A slot whose gpu work ends with a fence, set after the copies into the slot are queued
+struct ofxFencedReadback {
+	GLsync fence;
+
+	ofxFencedReadback() : fence(0) {}
+	~ofxFencedReadback() {
+		if (fence)
+			glDeleteSync(fence);
+	}
+
+	void setFence() {
+		if (fence)
+			glDeleteSync(fence);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	bool isDone() {
+		if (!fence)
+			return true;
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(fence);
+		fence = 0;
+		return true;
+	}
+};
+
+template<class Slot, int SIZE = 3>
+class ofxReadbackRing {
+	Slot slots[SIZE];
+	int first; // oldest slot in flight
+	int count;
+
+public:
+	ofxReadbackRing() : first(0), count(0) {}
+
+	// The slot for a new readback, NULL while the gpu is still busy with every slot
+	Slot* push() {
+		if (count == SIZE)
+			return NULL;
+		count++;
+		return &getNewest();
+	}
+
+	// Takes back the last push, e.g. when its readback is replaced before it was queried
+	void popNewest() {
+		if (count)
+			count--;
+	}
+
+	// done(slot) for the slots the gpu is done with, oldest first
+	template<class Done>
+	void collect(Done done) {
+		while (count && slots[first].isDone()) {
+			Slot& slot = slots[first];
+			first = (first + 1) % SIZE;
+			count--;
+			done(slot);
+		}
+	}
+
+	// forgets everything in flight
+	void clear() { count = 0; }
+
+	Slot& getNewest() { return slots[(first + count - 1) % SIZE]; }
+	bool isEmpty() const { return count == 0; }
+	// every slot, in flight or not, e.g. to allocate their buffers
+	Slot& operator[](int i) { return slots[i]; }
+	static int size() { return SIZE; }
+};
@@ -14,6 +14,9 @@
 #include "ofxColorize.h"
 #include "ofxColorize2d.h"
 #include "ofxColorize3d.h"
+#include "ftRemapShader.h"
+#include "ftNoiseLutShader.h"
+#include "ofxAssetCache.h"
 
 
 class ofxRecolor {
@@ -24,10 +27,12 @@ class ofxRecolor {
     // current texture swapping process. We tie the animations for both 2d and 1d in the same way
     float swapStartTime;
     float swapEndTime;
+    float time; // animation time, see setTime()
     
     
     GLuint texture3d;
     static const int NOISE_3D_SIZE = 32;
+    ofxAssetCache assetCache; // decoded LUTs and the 3d noise, rebuilt only when they change
     
     ofTexture defaultLut1d;
     ofImage temp;
@@ -35,21 +40,21 @@ class ofxRecolor {
     ofxColorize colorize1d;
     ofxColorize2d colorize2d;
     ofxColorize3d colorize3d;
+    flowTools::ftRemapShader remapShader;
+    ofTexture* remap; // see setRemap()
     
     static const int NOISE_SIZE = 128;
     constexpr static const double NOISE_SCALE = 32.0;
-    ofPixels noise1d;
-    ofTexture noise1dTexture;
+    ofFbo noise1dFbo; // normalized coordinates like the LUT images
+    flowTools::ftNoiseLutShader noiseShader;
+    
+    // the 1d noise LUT is generated on the gpu, only while it is drawn with
+    bool isNoiseUsed() {
+        return noiseDimension == 1 && (useNoise || currentTexture1d >= (int)textures1d.size() || nextTexture1d >= (int)textures1d.size());
+    }
     
     void updateNoise() {
-        ofColor_<unsigned char> color;
-        for(int i = 0; i < NOISE_SIZE; i++) {
-            color.r = 255.999 * ofNoise(i*NOISE_SCALE/NOISE_SIZE, ofGetElapsedTimef()/9.5123, 0);
-            color.g = 255.999 * ofNoise(i*NOISE_SCALE/NOISE_SIZE, ofGetElapsedTimef()/11.5123, 1);
-            color.b = 255.999 * ofNoise(i*NOISE_SCALE/NOISE_SIZE, ofGetElapsedTimef()/13.6123, 2);
-            noise1d.setColor(i, 0, color);
-        }
-        noise1dTexture.loadData(noise1d);
+        noiseShader.update(noise1dFbo, time, NOISE_SCALE);
     }
     
     void onNextTemplate1d(int &newTexture1d) {
@@ -78,29 +83,36 @@ class ofxRecolor {
         if (!useNoise && (currentTexture1d < textures1d.size())) {
             return textures1d[currentTexture1d];
         }
-        return noise1dTexture; //defaultLut1d;
+        return noise1dFbo.getTexture(); //defaultLut1d;
     }
     ofTexture& getTexture1d() {
         if (!useNoise && (nextTexture1d < textures1d.size())) {
             return textures1d[nextTexture1d];
         }
-        return noise1dTexture; // defaultLut1d;
+        return noise1dFbo.getTexture(); // defaultLut1d;
     }
     
-    void loadTextures(const std::string& path, std::vector<ofTexture>& target) {
+    // _maxSize > 0 scales larger images down to fit
+    void loadTextures(const std::string& path, std::vector<ofTexture>& target, int _maxSize) {
         ofDirectory dir(path);
         dir.allowExt("png");
         //populate the directory object
         dir.listDir();
         
         ofLogNotice() << "loading LUT textures for dir " << path;
-        ofImage loader;
+        std::vector<std::string> paths;
         for(int i = 0; i < dir.numFiles(); i++){
-            ofLogNotice() << (dir.getPath(i));
-            loader.loadImage(dir.getPath(i));
+            paths.push_back(dir.getPath(i));
+        }
+        std::vector<ofPixels> images;
+        assetCache.loadImages(paths, _maxSize, images);
+        for(size_t i = 0; i < images.size(); i++){
+            if(!images[i].isAllocated()) {
+                continue;
+            }
             ofTexture toLoad;
-            toLoad.allocate(loader.getPixelsRef(), false);
-            toLoad.loadData(loader.getPixelsRef());
+            toLoad.allocate(images[i], false);
+            toLoad.loadData(images[i]);
             toLoad.setTextureWrap(GL_MIRRORED_REPEAT, GL_MIRRORED_REPEAT);
             target.push_back(toLoad);
         }
@@ -108,7 +120,7 @@ class ofxRecolor {
     
     // random walk in 0..1 wth wrapping around the edges
     double randomWalk(double current, double divisor, double speed) {
-        current += (ofNoise(ofGetElapsedTimef()/divisor) - 0.5)*speed;
+        current += (ofNoise(time/divisor) - 0.5)*speed;
         return current - floor(current);
     }
     
@@ -124,21 +136,20 @@ class ofxRecolor {
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         
-        unsigned char * texData = new unsigned char[NOISE_3D_SIZE*NOISE_3D_SIZE*NOISE_3D_SIZE*3];
-        int pos = 0;
-        for(int x = 0; x < NOISE_3D_SIZE; x++) {
+        // z runs fastest, as it always has
+        std::vector<uint8_t> texData;
+        assetCache.loadVolume("noise3d", "ofNoise", NOISE_3D_SIZE, 3, [](int x, uint8_t* slice) {
+            int pos = 0;
             for(int y = 0; y < NOISE_3D_SIZE; y++) {
                 for(int z = 0; z < NOISE_3D_SIZE; z++) {
-                    texData[pos++] = ofNoise(x,y,z,0)*255;
-                    texData[pos++] = ofNoise(x,y,z,1)*255;
-                    texData[pos++] = ofNoise(x,y,z,2)*255;
+                    slice[pos++] = ofNoise(x,y,z,0)*255;
+                    slice[pos++] = ofNoise(x,y,z,1)*255;
+                    slice[pos++] = ofNoise(x,y,z,2)*255;
                 }
             }
-        }
+        }, texData);
         
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, NOISE_3D_SIZE, NOISE_3D_SIZE, NOISE_3D_SIZE, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-        
-        delete[] texData;
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, NOISE_3D_SIZE, NOISE_3D_SIZE, NOISE_3D_SIZE, 0, GL_RGB, GL_UNSIGNED_BYTE, texData.data());
     }
     
     
@@ -171,9 +182,26 @@ public:
     ofxRecolor() {
         textureIndex1d = 0;
         currentTexture1d = nextTexture1d = currentTexture2d = nextTexture2d = 0;
+        swapStartTime = swapEndTime = time = 0;
+        offsetState = externalOffset = offsetXState = offsetYState = rotateState = 0;
+        remap = NULL;
+    }
+    
+    // the app clock's time, so offline renders animate the same every time
+    void setTime(float _time) {
+        time = _time;
     }
     
-    void setup() {
+    // Undistortion / alignment applied while drawing into the buffer (see ofxCameraRemap), the mirror
+    // is part of it. NULL for none
+    void setRemap(ofTexture* _remap) {
+        remap = _remap;
+        colorize2d.setRemap(_remap);
+        colorize3d.setRemap(_remap);
+    }
+    
+    // LUT images larger than _maxLutSize on a side are scaled down, 0 keeps them as they are
+    void setup(int _maxLutSize = 0) {
         // create 1d lookup table
 
         lookup.allocate(1024, 1, OF_IMAGE_COLOR);
@@ -204,12 +232,17 @@ public:
         //defaultLut1d.loadData(temp.getPixelsRef());
         defaultLut1d.setTextureWrap(GL_MIRRORED_REPEAT, GL_MIRRORED_REPEAT);
         
-        noise1d.allocate(NOISE_SIZE, 1, 3);
-        noise1dTexture.allocate(noise1d, false);
-        noise1dTexture.setTextureWrap(GL_MIRRORED_REPEAT, GL_MIRRORED_REPEAT);
+        ofFbo::Settings noiseSettings;
+        noiseSettings.width = NOISE_SIZE;
+        noiseSettings.height = 1;
+        noiseSettings.internalformat = GL_RGB8;
+        noiseSettings.textureTarget = GL_TEXTURE_2D;
+        noiseSettings.wrapModeHorizontal = GL_MIRRORED_REPEAT;
+        noiseSettings.wrapModeVertical = GL_MIRRORED_REPEAT;
+        noise1dFbo.allocate(noiseSettings);
         
-        loadTextures("color1d/", textures1d);
-        loadTextures("color2d/", textures2d);
+        loadTextures("color1d/", textures1d, _maxLutSize);
+        loadTextures("color2d/", textures2d, _maxLutSize);
         
         initTexture3d();
         
@@ -261,7 +294,7 @@ public:
             if (animateScale) {
                 // scale animation is multiplicative, we'll exponentiate -1..1
                 // noise to get a range from 1/e to e which is close to the range we have
-                scaleAnimation = exp((ofNoise(ofGetElapsedTimef()/17.62357) - 0.5)*2);
+                scaleAnimation = exp((ofNoise(time/17.62357) - 0.5)*2);
             }
             
             float rotateAnimation = 0;
@@ -269,8 +302,8 @@ public:
                 rotateAnimation = rotateState*PI*2;
             }
             
-            if (ofGetElapsedTimef() >= swapEndTime) {
-                swapStartTime = ofGetElapsedTimef();
+            if (time >= swapEndTime) {
+                swapStartTime = time;
                 swapEndTime = swapStartTime + ofRandom(5,15);
                 if(animateTextures) {
                     currentTexture1d = nextTexture1d;
@@ -280,20 +313,24 @@ public:
                 }
             }
             
-            updateNoise();
+            if (isNoiseUsed()) {
+                updateNoise();
+            }
 
             switch(noiseDimension) {
                 case 1:
-                    colorize2d.update(_buffer, _source, getLastTexture1d(), getTexture1d(), _mirror, ofMap(ofGetElapsedTimef(), swapStartTime, swapEndTime, 0,1), scale*scaleAnimation, offset + offsetAnimation, 0, cutoff);
+                    colorize2d.update(_buffer, _source, getLastTexture1d(), getTexture1d(), _mirror, ofMap(time, swapStartTime, swapEndTime, 0,1), scale*scaleAnimation, offset + offsetAnimation, 0, cutoff);
                     break;
 
                 case 2:
-                    colorize2d.update(_buffer, _source, textures2d[currentTexture2d], textures2d[nextTexture2d], _mirror, ofMap(ofGetElapsedTimef(), swapStartTime, swapEndTime, 0,1), scale*scaleAnimation, offsetXAnimation, offsetYAnimation, cutoff, cos(rotateAnimation), sin(rotateAnimation));
+                    colorize2d.update(_buffer, _source, textures2d[currentTexture2d], textures2d[nextTexture2d], _mirror, ofMap(time, swapStartTime, swapEndTime, 0,1), scale*scaleAnimation, offsetXAnimation, offsetYAnimation, cutoff, cos(rotateAnimation), sin(rotateAnimation));
                     break;
                 case 3:
                     colorize3d.update(_buffer, _source, texture3d, texture3d, _mirror, 0, scale*scaleAnimation);
                     break;
             }
+        } else if (remap) {
+            remapShader.update(_buffer, _source, *remap);
         } else {
             _buffer.begin();
             if (_mirror)
@@ -0,0 +1,72 @@
+//
+//  ofxResolutionProfile.h
+//  visionquest
+//
+//  The resolution every stage of the processing chain runs at, picked at startup from resolution.xml so a
+//  smaller show pc can e.g. halve the velocity mask and keep the density sharp. Sizes are fractions of the
+//  output resolution, the visualizers are a fraction of the flow:
+//    <resolution>
+//      <profile>full</profile>              the one used unless --profile names another
+//      <full>
+//        <width>1280</width> <height>720</height>
+//        <source>1</source>                 cameraFbo and the passes before it (recolor, sources, background)
+//        <flow>0.25</flow>                  optical flow and the fluid velocity
+//        <mask>1</mask>                     velocity mask
+//        <density>1</density>               fluid density
+//        <particles>1</particles>
+//        <visualizers>0.25</visualizers>
+//        <lut>0</lut>                       largest side of the recolor LUT images in pixels, 0 keeps them as they are
+//      </full>
+//    </resolution>
+//  Missing values (or a missing file) are the full profile above.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxXmlSettings.h"
+
+class ofxResolutionProfile {
+public:
+	string name;
+	int width;
+	int height;
+	float source;
+	float flow;
+	float mask;
+	float density;
+	float particles;
+	float visualizers;
+	int lut; // pixels, 0 is full size
+
+	ofxResolutionProfile() : name("full"), width(1280), height(720), source(1), flow(0.25), mask(1), density(1), particles(1), visualizers(0.25), lut(0) {}
+
+	// The profile _name, or the selected one if empty. false (and the full profile) if it isn't there
+	bool load(const string& path, const string& _name = "") {
+		*this = ofxResolutionProfile();
+		ofxXmlSettings xml;
+		if (!ofFile::doesFileExist(path) || !xml.load(path))
+			return _name.empty();
+		name = _name.empty() ? xml.getValue("resolution:profile", name) : _name;
+		string tag = "resolution:" + name;
+		if (!xml.tagExists(tag)) {
+			ofLogError("ofxResolutionProfile") << "no profile " << name << " in " << path;
+			name = "full";
+			return false;
+		}
+		width = xml.getValue(tag + ":width", width);
+		height = xml.getValue(tag + ":height", height);
+		source = xml.getValue(tag + ":source", source);
+		flow = xml.getValue(tag + ":flow", flow);
+		mask = xml.getValue(tag + ":mask", mask);
+		density = xml.getValue(tag + ":density", density);
+		particles = xml.getValue(tag + ":particles", particles);
+		visualizers = xml.getValue(tag + ":visualizers", visualizers);
+		lut = xml.getValue(tag + ":lut", lut);
+		ofLogNotice("ofxResolutionProfile") << "profile " << name << ", " << width << "x" << height;
+		return true;
+	}
+
+	int getWidth(float scale) const { return MAX((int)(width * scale + 0.5f), 1); }
+	int getHeight(float scale) const { return MAX((int)(height * scale + 0.5f), 1); }
+};
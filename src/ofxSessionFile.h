@@ -0,0 +1,342 @@
+//
+//  ofxSessionFile.h
+//  visionquest
+//
+//  File format of recorded sessions (see ofxSessionRecorder / ofxSessionSource) and its reader.
+//
+//  header | chunk | chunk | ... | index chunk | trailer
+//
+//  Every chunk is a ChunkHeader followed by its payload, padded to 8 bytes so payloads can be used in place
+//  from the memory mapped file. Times are seconds since the start of the recording. The index lists every
+//  chunk sorted by time. It is written when the recording stops; a file without one (the app died while
+//  recording) is indexed by scanning its chunks instead.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxOsc.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ofxSession {
+	static const char MAGIC[8] = { 'V', 'Q', 'S', 'E', 'S', 'S', '0', '1' };
+
+	enum ChunkType {
+		CHUNK_PSEYE_FRAME = 1,
+		CHUNK_DEPTH_FRAME,
+		CHUNK_OSC,
+		CHUNK_PARAMETER,
+		CHUNK_INDEX,
+		CHUNK_RGB_FRAME,
+		CHUNK_TYPE_COUNT
+	};
+
+	struct ChunkHeader {
+		uint32_t type;
+		uint32_t size; // payload bytes, without padding
+		double time;
+	};
+
+	// payload of CHUNK_PSEYE_FRAME, followed by height * stride bytes
+	struct PsEyeFrameInfo {
+		uint16_t width;
+		uint16_t height;
+		uint32_t stride;
+		uint32_t format; // PS3EYECam::EOutputFormat
+		uint32_t reserved;
+	};
+
+	// payload of CHUNK_RGB_FRAME, a frame of any other source as it went into the processing chain,
+	// followed by height * stride bytes of 8 bit rgb
+	struct RgbFrameInfo {
+		uint16_t width;
+		uint16_t height;
+		uint32_t stride;
+	};
+
+	enum DepthCodec {
+		DEPTH_RAW = 0, // width * height 16 bit pixels
+		DEPTH_RVL // see ofxDepthCodec.h
+	};
+
+	// payload of CHUNK_DEPTH_FRAME, followed by depthBytes of depth and width * height bytes of body index
+	struct DepthFrameInfo {
+		uint16_t width;
+		uint16_t height;
+		uint8_t bodyCount;
+		uint8_t trackedBodies;
+		uint8_t codec; // DepthCodec
+		uint8_t reserved;
+		uint32_t depthBytes;
+		uint32_t reserved2;
+	};
+
+	struct IndexEntry {
+		double time;
+		uint64_t offset; // of the chunk header
+		uint32_t type;
+		uint32_t reserved;
+	};
+
+	struct Trailer {
+		uint64_t indexOffset; // of the index chunk header
+		uint64_t indexCount;
+		char magic[8];
+	};
+
+	inline size_t padded(size_t size) { return (size + 7) & ~(size_t)7; }
+
+	// Unaligned little helpers for the variable sized payloads
+	class Writer {
+		vector<uint8_t>& bytes;
+	public:
+		Writer(vector<uint8_t>& _bytes) : bytes(_bytes) {}
+		void write(const void* data, size_t size) {
+			const uint8_t* p = (const uint8_t*)data;
+			bytes.insert(bytes.end(), p, p + size);
+		}
+		template<typename T> void write(const T& value) { write(&value, sizeof(T)); }
+		void writeString(const string& value) {
+			write((uint32_t)value.size());
+			write(value.data(), value.size());
+		}
+	};
+
+	class Reader {
+		const uint8_t* data;
+		size_t size;
+		size_t position;
+	public:
+		Reader(const uint8_t* _data, size_t _size) : data(_data), size(_size), position(0) {}
+		bool read(void* dest, size_t bytes) {
+			if (position + bytes > size)
+				return false;
+			memcpy(dest, data + position, bytes);
+			position += bytes;
+			return true;
+		}
+		template<typename T> bool read(T& value) { return read(&value, sizeof(T)); }
+		bool readString(string& value) {
+			uint32_t length;
+			if (!read(length) || position + length > size)
+				return false;
+			value.assign((const char*)data + position, length);
+			position += length;
+			return true;
+		}
+	};
+
+	inline void serializeOsc(const ofxOscMessage& m, vector<uint8_t>& bytes) {
+		Writer writer(bytes);
+		writer.writeString(m.getAddress());
+		vector<int> types;
+		for (int i = 0; i < m.getNumArgs(); i++) {
+			switch (m.getArgType(i)) {
+			case OFXOSC_TYPE_INT32: case OFXOSC_TYPE_INT64: case OFXOSC_TYPE_FLOAT: case OFXOSC_TYPE_DOUBLE:
+			case OFXOSC_TYPE_STRING: case OFXOSC_TYPE_TRUE: case OFXOSC_TYPE_FALSE:
+				types.push_back(i);
+				break;
+			default: // nothing the app listens to
+				break;
+			}
+		}
+		writer.write((uint32_t)types.size());
+		for (size_t t = 0; t < types.size(); t++) {
+			int i = types[t];
+			char type = (char)m.getArgType(i);
+			writer.write(type);
+			switch (m.getArgType(i)) {
+			case OFXOSC_TYPE_INT32: writer.write((int32_t)m.getArgAsInt32(i)); break;
+			case OFXOSC_TYPE_INT64: writer.write((int64_t)m.getArgAsInt64(i)); break;
+			case OFXOSC_TYPE_FLOAT: writer.write(m.getArgAsFloat(i)); break;
+			case OFXOSC_TYPE_DOUBLE: writer.write(m.getArgAsDouble(i)); break;
+			case OFXOSC_TYPE_STRING: writer.writeString(m.getArgAsString(i)); break;
+			default: break;
+			}
+		}
+	}
+
+	inline bool deserializeOsc(const uint8_t* data, size_t size, ofxOscMessage& m) {
+		Reader reader(data, size);
+		string address;
+		uint32_t count;
+		if (!reader.readString(address) || !reader.read(count))
+			return false;
+		m.clear();
+		m.setAddress(address);
+		for (uint32_t i = 0; i < count; i++) {
+			char type;
+			if (!reader.read(type))
+				return false;
+			switch (type) {
+			case OFXOSC_TYPE_INT32: { int32_t v; if (!reader.read(v)) return false; m.addIntArg(v); } break;
+			case OFXOSC_TYPE_INT64: { int64_t v; if (!reader.read(v)) return false; m.addInt64Arg(v); } break;
+			case OFXOSC_TYPE_FLOAT: { float v; if (!reader.read(v)) return false; m.addFloatArg(v); } break;
+			case OFXOSC_TYPE_DOUBLE: { double v; if (!reader.read(v)) return false; m.addDoubleArg(v); } break;
+			case OFXOSC_TYPE_STRING: { string v; if (!reader.readString(v)) return false; m.addStringArg(v); } break;
+			case OFXOSC_TYPE_TRUE: m.addBoolArg(true); break;
+			case OFXOSC_TYPE_FALSE: m.addBoolArg(false); break;
+			default: return false;
+			}
+		}
+		return true;
+	}
+
+	inline void serializeParameter(const string& path, const string& value, vector<uint8_t>& bytes) {
+		Writer writer(bytes);
+		writer.writeString(path);
+		writer.writeString(value);
+	}
+
+	inline bool deserializeParameter(const uint8_t* data, size_t size, string& path, string& value) {
+		Reader reader(data, size);
+		return reader.readString(path) && reader.readString(value);
+	}
+}
+
+// Read only memory mapped session file with its index
+class ofxSessionReader {
+	const uint8_t* data;
+	size_t size;
+	vector<ofxSession::IndexEntry> index;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+
+	bool map(const string& path) {
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		size = (size_t)fileSize.QuadPart;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+			return false;
+		data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		fstat(file, &info);
+		size = info.st_size;
+		void* mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+		data = (mapped == MAP_FAILED) ? NULL : (const uint8_t*)mapped;
+#endif
+		return data != NULL;
+	}
+
+	void unmap() {
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+			munmap((void*)data, size);
+		if (file >= 0)
+			::close(file);
+		file = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	bool readIndex() {
+		using namespace ofxSession;
+		if (size < sizeof(MAGIC) + sizeof(Trailer))
+			return false;
+		Trailer trailer;
+		memcpy(&trailer, data + size - sizeof(Trailer), sizeof(Trailer));
+		if (memcmp(trailer.magic, MAGIC, sizeof(MAGIC)) != 0)
+			return false;
+		size_t first = trailer.indexOffset + sizeof(ChunkHeader);
+		if (first + trailer.indexCount * sizeof(IndexEntry) > size - sizeof(Trailer))
+			return false;
+		const IndexEntry* entries = (const IndexEntry*)(data + first);
+		index.assign(entries, entries + trailer.indexCount);
+		return true;
+	}
+
+	// for files that were not closed properly
+	void scanIndex() {
+		using namespace ofxSession;
+		index.clear();
+		size_t offset = sizeof(MAGIC);
+		while (offset + sizeof(ChunkHeader) <= size) {
+			const ChunkHeader* header = (const ChunkHeader*)(data + offset);
+			if (header->type == 0 || header->type == CHUNK_INDEX || header->type >= CHUNK_TYPE_COUNT || offset + sizeof(ChunkHeader) + header->size > size)
+				break;
+			IndexEntry entry = { header->time, offset, header->type, 0 };
+			index.push_back(entry);
+			offset += sizeof(ChunkHeader) + padded(header->size);
+		}
+		std::stable_sort(index.begin(), index.end(), [](const IndexEntry& a, const IndexEntry& b) { return a.time < b.time; });
+		ofLogWarning("ofxSessionReader") << "no index, recovered " << index.size() << " chunks";
+	}
+
+public:
+	ofxSessionReader() : data(NULL), size(0) {
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		file = -1;
+#endif
+	}
+	~ofxSessionReader() { close(); }
+
+	bool open(const string& path) {
+		close();
+		if (!map(ofToDataPath(path, true)) || size < sizeof(ofxSession::MAGIC) ||
+			memcmp(data, ofxSession::MAGIC, sizeof(ofxSession::MAGIC)) != 0) {
+			ofLogError("ofxSessionReader") << "can't open session " << path;
+			close();
+			return false;
+		}
+		if (!readIndex()) {
+			scanIndex();
+		}
+		return true;
+	}
+
+	void close() {
+		unmap();
+		index.clear();
+	}
+
+	bool isOpen() const { return data != NULL; }
+
+	size_t getNumChunks() const { return index.size(); }
+	double getDuration() const { return index.empty() ? 0 : index.back().time; }
+	const ofxSession::IndexEntry& getEntry(size_t i) const { return index[i]; }
+
+	// the first chunk at or after time
+	size_t seek(double time) const {
+		return std::lower_bound(index.begin(), index.end(), time,
+			[](const ofxSession::IndexEntry& entry, double t) { return entry.time < t; }) - index.begin();
+	}
+
+	const ofxSession::ChunkHeader& getHeader(size_t i) const {
+		return *(const ofxSession::ChunkHeader*)(data + index[i].offset);
+	}
+	const uint8_t* getPayload(size_t i) const {
+		return data + index[i].offset + sizeof(ofxSession::ChunkHeader);
+	}
+};
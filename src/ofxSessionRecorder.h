@@ -0,0 +1,291 @@
+//
+//  ofxSessionRecorder.h
+//  visionquest
+//
+//  Records the raw inputs of a show into a session file (see ofxSessionFile.h): PS3Eye frames as they come
+//  from the driver, Kinect depth + body index, every OSC message and every gui parameter change. Sources
+//  that can't record raw frames (the rig, the webcam, videos, pipelines) are recorded as rgb as they are
+//  handed to the processing chain, read back through an ofxReadbackRing so the render doesn't wait.
+//  The write calls only copy into a pooled chunk and queue it, a writer thread does the file I/O, so the
+//  capture threads and the render thread never wait on the disk. Depth is compressed losslessly on the
+//  Kinect's capture thread, which takes a few ms per frame and cuts the 25 MB/s of raw depth about 3x. When the queue falls too far behind,
+//  frames are dropped (and counted), events never are.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include "ofMain.h"
+#include "ofxOsc.h"
+#include "ftFbo.h"
+#include "ofxFrameSource.h"
+#include "ofxReadbackRing.h"
+#include "ofxSessionFile.h"
+#include "ofxDepthCodec.h"
+
+class ofxSessionRecorder : protected ofThread {
+	static const size_t MAX_QUEUED_BYTES = 256 << 20;
+
+	struct Chunk {
+		ofxSession::ChunkHeader header;
+		vector<uint8_t> payload;
+	};
+
+	FILE* file;
+	uint64_t fileOffset;
+	vector<ofxSession::IndexEntry> index;
+	double startTime;
+	std::atomic<bool> recording;
+	std::atomic<uint64_t> droppedFrames;
+
+	std::deque<Chunk*> queue;
+	vector<Chunk*> pool;
+	size_t queuedBytes;
+	std::mutex queueMutex;
+	std::condition_variable queueReady;
+
+	struct FrameReadback : ofxFencedReadback {
+		ofBufferObject buffer;
+		double time;
+		int width;
+		int height;
+	};
+	ofxReadbackRing<FrameReadback> frameReadbacks;
+	flowTools::ftFbo stagingFbo; // the frame as 8 bit rgb for the readback
+
+	// rows of a readback are 4 byte aligned
+	static int getReadbackStride(int width) { return (width * 3 + 3) & ~3; }
+
+	// returns NULL for frames when the writer is too far behind
+	Chunk* beginChunk(ofxSession::ChunkType type, double time, size_t reserve) {
+		std::lock_guard<std::mutex> lock(queueMutex);
+		bool isFrame = type == ofxSession::CHUNK_PSEYE_FRAME || type == ofxSession::CHUNK_DEPTH_FRAME || type == ofxSession::CHUNK_RGB_FRAME;
+		if (isFrame && queuedBytes + reserve > MAX_QUEUED_BYTES) {
+			droppedFrames++;
+			return NULL;
+		}
+		Chunk* chunk;
+		if (pool.empty()) {
+			chunk = new Chunk();
+		}
+		else {
+			chunk = pool.back();
+			pool.pop_back();
+		}
+		chunk->header.type = type;
+		chunk->header.time = time - startTime;
+		chunk->payload.clear();
+		chunk->payload.reserve(reserve);
+		return chunk;
+	}
+
+	void submit(Chunk* chunk) {
+		chunk->header.size = chunk->payload.size();
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			// stopped while this was being filled
+			if (!recording) {
+				pool.push_back(chunk);
+				return;
+			}
+			queue.push_back(chunk);
+			queuedBytes += chunk->payload.size();
+		}
+		queueReady.notify_one();
+	}
+
+	void writeChunk(const ofxSession::ChunkHeader& header, const void* payload) {
+		static const uint8_t zeros[8] = { 0 };
+		fwrite(&header, sizeof(header), 1, file);
+		fwrite(payload, 1, header.size, file);
+		size_t padding = ofxSession::padded(header.size) - header.size;
+		fwrite(zeros, 1, padding, file);
+		fileOffset += sizeof(header) + header.size + padding;
+	}
+
+	void threadedFunction() {
+		while (true) {
+			Chunk* chunk;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueReady.wait(lock, [this] { return !queue.empty() || !isThreadRunning(); });
+				// drain everything before stopping
+				if (queue.empty())
+					break;
+				chunk = queue.front();
+				queue.pop_front();
+			}
+
+			ofxSession::IndexEntry entry = { chunk->header.time, fileOffset, chunk->header.type, 0 };
+			index.push_back(entry);
+			writeChunk(chunk->header, chunk->payload.data());
+
+			std::lock_guard<std::mutex> lock(queueMutex);
+			queuedBytes -= chunk->payload.size();
+			pool.push_back(chunk);
+		}
+	}
+
+public:
+	ofxSessionRecorder() : file(NULL), fileOffset(0), startTime(0), recording(false), droppedFrames(0), queuedBytes(0) {}
+	~ofxSessionRecorder() {
+		stop();
+		for (size_t i = 0; i < pool.size(); i++) {
+			delete pool[i];
+		}
+	}
+
+	bool start(const string& path) {
+		stop();
+		file = fopen(ofToDataPath(path, true).c_str(), "wb");
+		if (!file) {
+			ofLogError("ofxSessionRecorder") << "can't create " << path;
+			return false;
+		}
+		fwrite(ofxSession::MAGIC, 1, sizeof(ofxSession::MAGIC), file);
+		fileOffset = sizeof(ofxSession::MAGIC);
+		index.clear();
+		frameReadbacks.clear();
+		droppedFrames = 0;
+		startTime = ofxFrameSource::now();
+		startThread();
+		recording = true;
+		ofLogNotice("ofxSessionRecorder") << "recording to " << path;
+		return true;
+	}
+
+	void stop() {
+		if (!recording)
+			return;
+		recording = false;
+		frameReadbacks.clear();
+		stopThread();
+		queueReady.notify_all();
+		waitForThread(false);
+
+		// the chunks of the capture threads and the render thread arrive slightly out of order
+		std::stable_sort(index.begin(), index.end(), [](const ofxSession::IndexEntry& a, const ofxSession::IndexEntry& b) { return a.time < b.time; });
+		ofxSession::Trailer trailer;
+		trailer.indexOffset = fileOffset;
+		trailer.indexCount = index.size();
+		memcpy(trailer.magic, ofxSession::MAGIC, sizeof(trailer.magic));
+		ofxSession::ChunkHeader header = { ofxSession::CHUNK_INDEX, (uint32_t)(index.size() * sizeof(ofxSession::IndexEntry)), 0 };
+		writeChunk(header, index.data());
+		fwrite(&trailer, sizeof(trailer), 1, file);
+		fclose(file);
+		file = NULL;
+		ofLogNotice("ofxSessionRecorder") << "recorded " << index.size() << " chunks, dropped " << droppedFrames << " frames";
+	}
+
+	bool isRecording() const { return recording; }
+	uint64_t getDroppedFrames() const { return droppedFrames; }
+
+	// Any thread. time is ofxFrameSource::now()
+	void writePsEyeFrame(double time, const uint8_t* pixels, int width, int height, int stride, int format) {
+		if (!recording)
+			return;
+		int rowBytes = width * (format == 0 ? 2 : 1); // yuyv or raw bayer
+		Chunk* chunk = beginChunk(ofxSession::CHUNK_PSEYE_FRAME, time, sizeof(ofxSession::PsEyeFrameInfo) + rowBytes * height);
+		if (!chunk)
+			return;
+		ofxSession::PsEyeFrameInfo info = { (uint16_t)width, (uint16_t)height, (uint32_t)rowBytes, (uint32_t)format, 0 };
+		ofxSession::Writer writer(chunk->payload);
+		writer.write(info);
+		for (int y = 0; y < height; y++) {
+			writer.write(pixels + y * stride, rowBytes);
+		}
+		submit(chunk);
+	}
+
+	void writeDepthFrame(double time, const uint16_t* depth, const uint8_t* bodyIndex, int width, int height, int bodyCount, int trackedBodies) {
+		if (!recording)
+			return;
+		size_t pixels = width * height;
+		// reserved (and checked against the queue budget) at the raw size, the coded depth is smaller
+		Chunk* chunk = beginChunk(ofxSession::CHUNK_DEPTH_FRAME, time, sizeof(ofxSession::DepthFrameInfo) + pixels * sizeof(uint16_t) + pixels);
+		if (!chunk)
+			return;
+		ofxSession::DepthFrameInfo info = { (uint16_t)width, (uint16_t)height, (uint8_t)bodyCount, (uint8_t)trackedBodies, ofxSession::DEPTH_RVL, 0, 0, 0 };
+		ofxSession::Writer writer(chunk->payload);
+		writer.write(info);
+		info.depthBytes = (uint32_t)ofxDepthCodec::encode(depth, pixels, chunk->payload);
+		memcpy(chunk->payload.data(), &info, sizeof(info));
+		writer.write(bodyIndex, pixels);
+		submit(chunk);
+	}
+
+	// Render thread. A frame of a source that doesn't record itself, as it goes into the processing chain.
+	// Queued by update() once the gpu has read it back
+	void writeFrame(double time, ofTexture& texture) {
+		if (!recording || !texture.isAllocated())
+			return;
+		// the gpu is far behind, the disk most likely too
+		FrameReadback* readback = frameReadbacks.push();
+		if (!readback) {
+			droppedFrames++;
+			return;
+		}
+		int width = texture.getWidth();
+		int height = texture.getHeight();
+		if (!stagingFbo.isAllocated() || stagingFbo.getWidth() != width || stagingFbo.getHeight() != height) {
+			stagingFbo.allocate(width, height, GL_RGB);
+		}
+		ofPushStyle();
+		ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+		stagingFbo.begin();
+		texture.draw(0, 0, width, height);
+		stagingFbo.end();
+		ofPopStyle();
+		size_t bytes = (size_t)getReadbackStride(width) * height;
+		if (!readback->buffer.isAllocated() || readback->buffer.size() != bytes) {
+			readback->buffer.allocate(bytes, GL_STREAM_READ);
+		}
+		stagingFbo.getTexture().copyTo(readback->buffer);
+		readback->setFence();
+		readback->time = time;
+		readback->width = width;
+		readback->height = height;
+	}
+
+	// Render thread, once a frame. Queues the frames the gpu is done reading back
+	void update() {
+		frameReadbacks.collect([this](FrameReadback& readback) {
+			int rowBytes = readback.width * 3;
+			Chunk* chunk = beginChunk(ofxSession::CHUNK_RGB_FRAME, readback.time, sizeof(ofxSession::RgbFrameInfo) + rowBytes * readback.height);
+			if (!chunk)
+				return;
+			const uint8_t* pixels = (const uint8_t*)readback.buffer.map(GL_READ_ONLY);
+			if (!pixels) {
+				std::lock_guard<std::mutex> lock(queueMutex);
+				pool.push_back(chunk);
+				return;
+			}
+			ofxSession::RgbFrameInfo info = { (uint16_t)readback.width, (uint16_t)readback.height, (uint32_t)rowBytes };
+			ofxSession::Writer writer(chunk->payload);
+			writer.write(info);
+			int stride = getReadbackStride(readback.width);
+			for (int y = 0; y < readback.height; y++) {
+				writer.write(pixels + y * stride, rowBytes);
+			}
+			readback.buffer.unmap();
+			submit(chunk);
+		});
+	}
+
+	void writeOsc(double time, const ofxOscMessage& m) {
+		if (!recording)
+			return;
+		Chunk* chunk = beginChunk(ofxSession::CHUNK_OSC, time, 64);
+		ofxSession::serializeOsc(m, chunk->payload);
+		submit(chunk);
+	}
+
+	void writeParameter(double time, const string& path, const string& value) {
+		if (!recording)
+			return;
+		Chunk* chunk = beginChunk(ofxSession::CHUNK_PARAMETER, time, path.size() + value.size() + 8);
+		ofxSession::serializeParameter(path, value, chunk->payload);
+		submit(chunk);
+	}
+};
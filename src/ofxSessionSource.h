@@ -0,0 +1,259 @@
+//
+//  ofxSessionSource.h
+//  visionquest
+//
+//  Replays a recorded session (see ofxSessionRecorder) as an ofxFrameSource. Frames are uploaded straight
+//  from the memory mapped file and converted on the gpu (YUYV and Bayer PS3Eye frames) or used as is
+//  (Kinect depth + body index, the rgb frames of every other source). The OSC messages and parameter changes recorded between two frames are
+//  handed to the app before that frame, in recorded order, so a replay feeds the app the same inputs in
+//  the same order every time.
+//  With a speed of 0 every update() plays exactly one recorded frame, which replays as fast as the app
+//  runs; any other speed follows the recorded timing. A fixed step follows the recorded timing on the
+//  app's virtual clock instead (see ofxClock), for offline renders.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxOsc.h"
+#include "ftFbo.h"
+#include "ofxFrameSource.h"
+#include "ofxSessionFile.h"
+#include "ofxDepthCodec.h"
+#include "ftStitchShader.h"
+#include "ftDebayerShader.h"
+
+class ofxSessionSource : public ofxFrameSource {
+public:
+	struct ParameterChange {
+		string path; // group names from the gui root down to the parameter, escaped
+		string value;
+	};
+
+private:
+	ofxSessionReader reader;
+	string path;
+	double startTime; // session seconds to start (and loop) from
+	float speed;
+	double fixedStep; // session seconds per update(), 0 follows the wall clock
+	int loops;
+
+	size_t position; // next chunk
+	double sessionTime;
+	double lastUpdateTime;
+
+	vector<ofxOscMessage> oscMessages;
+	vector<ParameterChange> parameterChanges;
+
+	bool isDepth;
+	bool isRgb;
+	int bodyCount;
+	int trackedBodies;
+	ofTexture rawTexture; // yuyv (half width rgba) or bayer
+	ofTexture rgbTexture;
+	ofTexture depthTexture;
+	vector<uint16_t> depthPixels; // decoded compressed depth
+	ofTexture bodyIndexTexture;
+	ofxTextureUploader rawUploader;
+	ofxTextureUploader rgbUploader;
+	ofxTextureUploader depthUploader;
+	ofxTextureUploader bodyIndexUploader;
+	flowTools::ftFbo colorFbo;
+	flowTools::ftStitchShader yuyvShader;
+	flowTools::ftDebayerShader debayerShader;
+
+	void collectEvent(size_t i) {
+		const ofxSession::ChunkHeader& header = reader.getHeader(i);
+		const uint8_t* payload = reader.getPayload(i);
+		if (header.type == ofxSession::CHUNK_OSC) {
+			ofxOscMessage m;
+			if (ofxSession::deserializeOsc(payload, header.size, m)) {
+				oscMessages.push_back(m);
+			}
+		}
+		else if (header.type == ofxSession::CHUNK_PARAMETER) {
+			ParameterChange change;
+			if (ofxSession::deserializeParameter(payload, header.size, change.path, change.value)) {
+				parameterChanges.push_back(change);
+			}
+		}
+	}
+
+	static bool isFrame(uint32_t type) {
+		return type == ofxSession::CHUNK_PSEYE_FRAME || type == ofxSession::CHUNK_DEPTH_FRAME || type == ofxSession::CHUNK_RGB_FRAME;
+	}
+
+	void uploadFrame(size_t i) {
+		const ofxSession::ChunkHeader& header = reader.getHeader(i);
+		const uint8_t* payload = reader.getPayload(i);
+		if (header.type == ofxSession::CHUNK_PSEYE_FRAME) {
+			const ofxSession::PsEyeFrameInfo* info = (const ofxSession::PsEyeFrameInfo*)payload;
+			const uint8_t* pixels = payload + sizeof(ofxSession::PsEyeFrameInfo);
+			bool bayer = info->format != 0;
+			if (!colorFbo.isAllocated() || colorFbo.getWidth() != info->width || colorFbo.getHeight() != info->height) {
+				colorFbo.allocate(info->width, info->height, GL_RGB);
+			}
+			if (bayer) {
+				if (!rawTexture.isAllocated() || rawTexture.getWidth() != info->width) {
+					rawTexture.allocate(info->width, info->height, GL_R8);
+				}
+				rawUploader.upload(rawTexture, pixels, info->width, info->height, 1, GL_RED, GL_UNSIGNED_BYTE);
+				debayerShader.update(colorFbo, rawTexture);
+			}
+			else {
+				if (!rawTexture.isAllocated() || rawTexture.getWidth() != info->width / 2) {
+					rawTexture.allocate(info->width / 2, info->height, GL_RGBA8);
+					rawTexture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+				}
+				rawUploader.upload(rawTexture, pixels, info->width / 2, info->height, 4, GL_RGBA, GL_UNSIGNED_BYTE);
+				vector<ofTexture*> textures(1, &rawTexture);
+				vector<ofRectangle> rects(1, ofRectangle(0, 0, info->width, info->height));
+				yuyvShader.update(colorFbo, textures, rects, info->width, info->height, 0);
+			}
+			isDepth = false;
+			isRgb = false;
+		}
+		else if (header.type == ofxSession::CHUNK_RGB_FRAME) {
+			const ofxSession::RgbFrameInfo* info = (const ofxSession::RgbFrameInfo*)payload;
+			const uint8_t* pixels = payload + sizeof(ofxSession::RgbFrameInfo);
+			if (!rgbTexture.isAllocated() || rgbTexture.getWidth() != info->width || rgbTexture.getHeight() != info->height) {
+				rgbTexture.allocate(info->width, info->height, GL_RGB8);
+			}
+			rgbUploader.upload(rgbTexture, pixels, info->width, info->height, 3, GL_RGB, GL_UNSIGNED_BYTE, info->stride);
+			isDepth = false;
+			isRgb = true;
+		}
+		else {
+			const ofxSession::DepthFrameInfo* info = (const ofxSession::DepthFrameInfo*)payload;
+			const uint8_t* depth = payload + sizeof(ofxSession::DepthFrameInfo);
+			const uint8_t* bodyIndex = depth + info->depthBytes;
+			if (!depthTexture.isAllocated() || depthTexture.getWidth() != info->width) {
+				depthTexture.allocate(info->width, info->height, GL_R16);
+				depthTexture.setRGToRGBASwizzles(true);
+				bodyIndexTexture.allocate(info->width, info->height, GL_R8);
+			}
+			if (info->codec == ofxSession::DEPTH_RVL) {
+				depthPixels.resize(info->width * info->height);
+				if (!ofxDepthCodec::decode(depth, info->depthBytes, depthPixels.data(), depthPixels.size())) {
+					ofLogWarning("ofxSessionSource") << "corrupt depth frame at " << reader.getEntry(i).time;
+				}
+				depthUploader.upload(depthTexture, depthPixels.data(), info->width, info->height, 2, GL_RED, GL_UNSIGNED_SHORT);
+			}
+			else {
+				depthUploader.upload(depthTexture, depth, info->width, info->height, 2, GL_RED, GL_UNSIGNED_SHORT);
+			}
+			bodyIndexUploader.upload(bodyIndexTexture, bodyIndex, info->width, info->height, 1, GL_RED, GL_UNSIGNED_BYTE);
+			bodyCount = info->bodyCount;
+			trackedBodies = info->trackedBodies;
+			isDepth = true;
+			isRgb = false;
+		}
+		frameSequence++;
+		frameTime = now();
+	}
+
+public:
+	ofxSessionSource() : path("sessions/replay.vqs"), startTime(0), speed(1), fixedStep(0), loops(0), position(0), sessionTime(0), lastUpdateTime(0),
+		isDepth(false), isRgb(false), bodyCount(0), trackedBodies(0) {}
+
+	string getName() const { return "session"; }
+
+	// takes effect on the next open()
+	void setup(const string& _path, double _startTime = 0) {
+		path = _path;
+		startTime = _startTime;
+	}
+	// 0 plays one recorded frame per update(), 1 is real time
+	void setSpeed(float _speed) { speed = _speed; }
+	// overrides the speed while > 0
+	void setFixedStep(double _step) { fixedStep = _step; }
+
+	bool open() {
+		if (reader.isOpen())
+			return true;
+		if (!reader.open(path))
+			return false;
+		seek(startTime);
+		loops = 0;
+		ofLogNotice("ofxSessionSource") << "replaying " << path << " (" << reader.getDuration() << " sec) from " << startTime;
+		return true;
+	}
+
+	void close() { reader.close(); }
+	bool isOpen() const { return reader.isOpen(); }
+
+	void seek(double time) {
+		position = reader.seek(time);
+		sessionTime = time;
+		lastUpdateTime = now();
+	}
+
+	// Collects the events up to the next due frame and uploads it. Returns true if there was a frame
+	bool update() {
+		oscMessages.clear();
+		parameterChanges.clear();
+		if (!reader.isOpen() || reader.getNumChunks() == 0)
+			return false;
+
+		double time = now();
+		bool timed = fixedStep > 0 || speed > 0;
+		if (fixedStep > 0) {
+			sessionTime += fixedStep;
+		}
+		else if (speed > 0) {
+			sessionTime += (time - lastUpdateTime) * speed;
+		}
+		lastUpdateTime = time;
+
+		// loop
+		if (position >= reader.getNumChunks()) {
+			seek(startTime);
+			loops++;
+		}
+
+		long frame = -1;
+		while (position < reader.getNumChunks()) {
+			const ofxSession::IndexEntry& entry = reader.getEntry(position);
+			if (timed && entry.time > sessionTime)
+				break;
+			if (isFrame(entry.type)) {
+				// behind the recorded timing only the newest frame is uploaded, the events all go through
+				frame = position++;
+				if (!timed)
+					break;
+			}
+			else {
+				collectEvent(position++);
+			}
+		}
+		if (frame < 0)
+			return false;
+		if (!timed) {
+			sessionTime = reader.getEntry(frame).time;
+		}
+		uploadFrame(frame);
+		return true;
+	}
+
+	ofTexture& getTexture() { return isDepth ? depthTexture : isRgb ? rgbTexture : colorFbo.getTexture(); }
+
+	// a replay isn't recorded again
+	bool setRecorder(ofxSessionRecorder* recorder) { return true; }
+
+	// events collected by the last update(), in recorded order
+	const vector<ofxOscMessage>& getOscMessages() const { return oscMessages; }
+	const vector<ParameterChange>& getParameterChanges() const { return parameterChanges; }
+
+	// the current frame is a Kinect depth frame
+	bool isDepthFrame() const { return isDepth; }
+	// the last depth frame, also while color frames are presented
+	ofTexture& getDepthTexture() { return depthTexture; }
+	ofTexture& getBodyIndexTexture() { return bodyIndexTexture; }
+	int getBodyCount() const { return bodyCount; }
+	int getNumTrackedBodies() const { return trackedBodies; }
+
+	double getSessionTime() const { return sessionTime; }
+	double getDuration() const { return reader.getDuration(); }
+	// times the replay went back to the start
+	int getLoopCount() const { return loops; }
+};
@@ -0,0 +1,156 @@
+//
+//  ofxSourceManager.h
+//  visionquest
+//
+//  Keeps only the sources that are needed open. The active source is opened on demand, the one that is
+//  most likely selected next is pre-opened and kept warm (its thread captures and a frame is uploaded now
+//  and then) so switching to it is instant, every other source is parked: closed after parkDelay so an
+//  idle camera costs no USB bandwidth and no CPU. A pre-open is speculative: it must not take devices from
+//  live sources or change settings, and a source that fails to open is retried less and less often.
+//  Sessions are recorded from the active source alone, whichever it is: it records its raw frames itself
+//  if it can, otherwise record() takes its frames as they are handed to the processing chain.
+//
+
+#pragma once
+
+#include <functional>
+#include "ofMain.h"
+#include "ofxFrameSource.h"
+#include "ofxSessionRecorder.h"
+
+class ofxSourceManager {
+	static constexpr float RETRY_INTERVAL = 5; // seconds until a source that failed is pre-opened again, doubles with every failure
+	static constexpr float MAX_RETRY_INTERVAL = 300;
+	static constexpr float WARM_UPDATE_INTERVAL = 1; // seconds between uploads of the pre-opened source
+
+	struct Entry {
+		ofxFrameSource* source;
+		float lastUsed;
+		float lastFailed;
+		float retryInterval; // 0 unless the last open failed
+		float lastWarmUpdate;
+	};
+	vector<Entry> entries;
+
+	std::function<ofxFrameSource&(int)> getSource;
+	std::function<bool(int, bool)> openSource;
+	ofxSessionRecorder* recorder;
+
+	Entry* find(ofxFrameSource& source) {
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (entries[i].source == &source)
+				return &entries[i];
+		}
+		return NULL;
+	}
+
+	void opened(Entry* entry, bool success, float now) {
+		if (!entry)
+			return;
+		if (success) {
+			entry->retryInterval = 0;
+		}
+		else {
+			entry->retryInterval = entry->retryInterval > 0 ? MIN(entry->retryInterval * 2, MAX_RETRY_INTERVAL) : RETRY_INTERVAL;
+			entry->lastFailed = now;
+		}
+	}
+
+public:
+	ofParameterGroup parameters;
+	ofParameter<bool> preWarm;
+	ofParameter<float> parkDelay; // seconds an unused source stays open, so switching back and forth stays instant
+
+	ofxSourceManager() : recorder(NULL) {
+		parameters.setName("sources");
+		parameters.add(preWarm.set("Pre-open next source", true));
+		parameters.add(parkDelay.set("Park after (sec)", 5, 0, 60));
+	}
+
+	// _getSource maps a source mode to its source, _openSource(mode, speculative) opens it with the app settings.
+	// Speculative opens are the pre-opens, they leave live sources and the settings alone
+	void setup(std::function<ofxFrameSource&(int)> _getSource, std::function<bool(int, bool)> _openSource) {
+		getSource = _getSource;
+		openSource = _openSource;
+	}
+
+	void setRecorder(ofxSessionRecorder* _recorder) { recorder = _recorder; }
+
+	void add(ofxFrameSource& source) {
+		if (find(source))
+			return;
+		Entry entry = { &source, 0, 0, 0, 0 };
+		entries.push_back(entry);
+	}
+
+	// Call once a frame before updating the active source. Returns false if the active source can't be opened
+	bool update(int activeMode, int nextMode) {
+		float now = ofGetElapsedTimef();
+
+		ofxFrameSource& active = getSource(activeMode);
+		Entry* activeEntry = find(active);
+		bool activeOpen = active.isOpen();
+		if (!activeOpen) {
+			activeOpen = openSource(activeMode, false);
+			opened(activeEntry, activeOpen, now);
+		}
+		if (activeEntry)
+			activeEntry->lastUsed = now;
+
+		ofxFrameSource* next = NULL;
+		if (preWarm && nextMode != activeMode && &getSource(nextMode) != &active) {
+			next = &getSource(nextMode);
+			Entry* nextEntry = find(*next);
+			if (nextEntry && !next->isOpen() && now - nextEntry->lastFailed >= nextEntry->retryInterval) {
+				ofLogNotice("ofxSourceManager") << "pre-opening " << next->getName();
+				opened(nextEntry, openSource(nextMode, true), now);
+			}
+			if (nextEntry && next->isOpen()) {
+				nextEntry->lastUsed = now;
+				// keep a frame uploaded, the first upload allocates
+				if (now - nextEntry->lastWarmUpdate >= WARM_UPDATE_INTERVAL) {
+					next->update();
+					nextEntry->lastWarmUpdate = now;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < entries.size(); i++) {
+			Entry& entry = entries[i];
+			// only the active source records, see record()
+			if (!active.contains(*entry.source)) {
+				entry.source->setRecorder(NULL);
+			}
+			if (!entry.source->isOpen())
+				continue;
+			// the parts of a combined source are in use with it
+			if (active.contains(*entry.source) || (next && next->contains(*entry.source))) {
+				entry.lastUsed = now;
+				continue;
+			}
+			if (now - entry.lastUsed >= parkDelay) {
+				ofLogNotice("ofxSourceManager") << "parking " << entry.source->getName();
+				entry.source->close();
+			}
+		}
+
+		if (recorder) {
+			recorder->update();
+		}
+		return activeOpen;
+	}
+
+	// Render thread, with the active source's new frame as it goes into the processing chain. The source gets
+	// the recorder, the frame is only recorded here if the source doesn't record itself
+	void record(ofxFrameSource& active) {
+		if (!recorder || active.setRecorder(recorder) || !recorder->isRecording())
+			return;
+		recorder->writeFrame(active.getFrameTime(), active.getTexture());
+	}
+
+	void close() {
+		for (size_t i = 0; i < entries.size(); i++) {
+			entries[i].source->close();
+		}
+	}
+};
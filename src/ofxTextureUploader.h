@@ -0,0 +1,150 @@
+//
+//  ofxTextureUploader.h
+//  visionquest
+//
+//  Streams cpu frames into a texture through a ring of pixel buffer objects. An upload copies the frame into
+//  the next slot of the ring and queues the glTexSubImage2D from there, so it returns without waiting for the
+//  driver to take the pixels, and a fence per slot tells when the gpu has read it. With GL_ARB_buffer_storage
+//  the ring stays mapped for its whole life, otherwise the slot is mapped unsynchronized (the fence already
+//  says the gpu is done with it). The ring is NUM_SLOTS uploads deep: only a gpu that many frames behind still
+//  reads the next slot, and then the frame goes up the plain way instead of waiting for it.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+class ofxTextureUploader {
+public:
+	static const int NUM_SLOTS = 3;
+
+private:
+	GLuint buffer;
+	size_t slotSize;
+	uint8_t* mapped; // the whole ring while persistently mapped
+	bool persistent;
+	GLsync fences[NUM_SLOTS];
+	int next;
+	uint64_t fallbacks;
+
+	void reserve(size_t size) {
+		release();
+		slotSize = size;
+		persistent = ofGLCheckExtension("GL_ARB_buffer_storage");
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize * NUM_SLOTS, NULL, flags);
+			mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize * NUM_SLOTS, flags);
+			persistent = mapped != NULL;
+		}
+		if (!persistent) {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize * NUM_SLOTS, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	void release() {
+		for (int i = 0; i < NUM_SLOTS; i++) {
+			if (fences[i]) {
+				glDeleteSync(fences[i]);
+				fences[i] = 0;
+			}
+		}
+		if (buffer) {
+			if (mapped) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+		buffer = 0;
+		mapped = NULL;
+		slotSize = 0;
+		next = 0;
+	}
+
+	// pixels is an offset into the bound unpack buffer or client memory
+	static void texSubImage(ofTexture& texture, const void* pixels, int width, int height, GLenum glFormat, GLenum glType, int rowLength) {
+		const ofTextureData& data = texture.getTextureData();
+		glBindTexture(data.textureTarget, data.textureID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+		glTexSubImage2D(data.textureTarget, 0, 0, 0, width, height, glFormat, glType, pixels);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(data.textureTarget, 0);
+	}
+
+public:
+	ofxTextureUploader() : buffer(0), slotSize(0), mapped(NULL), persistent(false), next(0), fallbacks(0) {
+		for (int i = 0; i < NUM_SLOTS; i++) {
+			fences[i] = 0;
+		}
+	}
+	~ofxTextureUploader() { release(); }
+
+	// Replaces the contents of texture, which is allocated at the frame's size. Rows are stride bytes apart,
+	// 0 for tightly packed ones
+	void upload(ofTexture& texture, const void* data, int width, int height, int bytesPerPixel, GLenum glFormat, GLenum glType, int stride = 0) {
+		size_t rowBytes = (size_t)width * bytesPerPixel;
+		size_t size = rowBytes * height;
+		if (stride <= 0) {
+			stride = rowBytes;
+		}
+		if (size > slotSize) {
+			reserve(size);
+		}
+
+		GLsync& fence = fences[next];
+		if (fence) {
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				fallbacks++;
+				texSubImage(texture, data, width, height, glFormat, glType, stride / bytesPerPixel);
+				return;
+			}
+			glDeleteSync(fence);
+			fence = 0;
+		}
+
+		size_t offset = next * slotSize;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		uint8_t* dst = persistent ? mapped + offset :
+			(uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!dst) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			fallbacks++;
+			texSubImage(texture, data, width, height, glFormat, glType, stride / bytesPerPixel);
+			return;
+		}
+		const uint8_t* src = (const uint8_t*)data;
+		if (stride == (int)rowBytes) {
+			memcpy(dst, src, size);
+		}
+		else {
+			for (int y = 0; y < height; y++) {
+				memcpy(dst + y * rowBytes, src + y * stride, rowBytes);
+			}
+		}
+		if (!persistent) {
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		texSubImage(texture, (const void*)offset, width, height, glFormat, glType, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		next = (next + 1) % NUM_SLOTS;
+	}
+
+	void upload(ofTexture& texture, const ofPixels& pixels) {
+		upload(texture, pixels.getData(), pixels.getWidth(), pixels.getHeight(), pixels.getBytesPerPixel(), ofGetGlFormat(pixels), GL_UNSIGNED_BYTE);
+	}
+
+	void upload(ofTexture& texture, const ofShortPixels& pixels) {
+		upload(texture, pixels.getData(), pixels.getWidth(), pixels.getHeight(), pixels.getBytesPerPixel(), ofGetGlFormat(pixels), GL_UNSIGNED_SHORT);
+	}
+
+	// uploads that went the plain way because the gpu still read the slot
+	uint64_t getFallbacks() const { return fallbacks; }
+};
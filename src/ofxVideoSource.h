@@ -0,0 +1,321 @@
+//
+//  ofxVideoSource.h
+//  visionquest
+//
+//  A looping playlist of video files as an ofxFrameSource. A decode thread steps through the current clip
+//  into a bounded ring of converted frames that runs ahead of playback, the render thread presents them
+//  at the clip frame rate and only uploads. The next clip (the same file again for a single clip loop) is
+//  opened by a loader thread a few seconds before the current one ends, so neither loop points nor clip
+//  changes stall playback as long as the ring covers the switch.
+//  With a fixed step (offline renders, see ofxClock) playback follows the virtual clock instead and waits
+//  for the decoder rather than missing frames.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include "ofMain.h"
+#include "ofxFrameSource.h"
+
+class ofxVideoSource : public ofxFrameSource, protected ofThread {
+	static const int RING_SIZE = 12; // decoded frames kept ahead of playback
+	static constexpr double PREOPEN_TIME = 2; // seconds before the end of a clip to open the next one
+
+	struct Slot {
+		ofxSourceFrame frame;
+		double duration;
+		int loop; // passes through the playlist before this frame
+		int clip; // index into playlist
+		int clipFrame;
+		int clipFrames; // of the clip, 0 if unknown
+	};
+
+	// opens a clip off the decode thread
+	class Loader : public ofThread {
+	public:
+		ofVideoPlayer* player;
+		string path;
+		bool loaded;
+
+		Loader() : player(NULL), loaded(false) {}
+
+		void threadedFunction() {
+			loaded = open(*player, path);
+		}
+
+		static bool open(ofVideoPlayer& player, const string& path) {
+			player.setUseTexture(false);
+			if (!player.load(path)) {
+				ofLogError("ofxVideoSource") << "failed to load " << path;
+				return false;
+			}
+			// the decode thread steps through the frames itself
+			player.setLoopState(OF_LOOP_NONE);
+			player.play();
+			player.setPaused(true);
+			return true;
+		}
+	};
+
+	vector<string> playlist;
+	ofVideoPlayer players[2];
+	Loader loader;
+	int current; // index into players
+	int clipIndex; // index into playlist
+	int clipFrame; // frames decoded from the current clip
+	int decodeLoops;
+	int loops; // of the presented frame
+	int presentedClip;
+	int presentedClipFrame;
+	int presentedClipFrames;
+	bool nextLoading;
+
+	Slot ring[RING_SIZE];
+	int ringStart;
+	int ringCount;
+	std::mutex ringMutex;
+	std::condition_variable ringSpace;
+	std::condition_variable ringFilled;
+
+	ofTexture texture;
+	ofxTextureUploader uploader;
+	uint64_t decodedFrames;
+	double presentTime; // when the frame at the front of the ring is due
+	double fixedStep;
+	double virtualTime;
+	bool opened;
+
+	static double getFrameDuration(ofVideoPlayer& player) {
+		int frames = player.getTotalNumFrames();
+		float duration = player.getDuration();
+		return (frames > 0 && duration > 0) ? duration / frames : 1.0 / 30;
+	}
+
+	// decode thread. Decodes the next frame of the clip into the back of the ring, false at the end of the clip
+	bool decodeFrame(ofVideoPlayer& player) {
+		int frames = player.getTotalNumFrames();
+		if (clipFrame > 0) {
+			if ((frames > 0 && clipFrame >= frames) || player.getIsMovieDone())
+				return false;
+			player.nextFrame();
+		}
+		player.update();
+
+		// only this thread fills the back slot, the lock is for the consistent start and count
+		int back;
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			back = (ringStart + ringCount) % RING_SIZE;
+		}
+		Slot& slot = ring[back];
+		slot.frame.pixels = player.getPixels();
+		slot.frame.sequence = ++decodedFrames;
+		slot.frame.captureTime = now();
+		slot.duration = getFrameDuration(player);
+		slot.loop = decodeLoops;
+		slot.clip = clipIndex;
+		slot.clipFrame = clipFrame;
+		slot.clipFrames = MAX(frames, 0);
+		clipFrame++;
+
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			ringCount++;
+		}
+		ringFilled.notify_one();
+		return true;
+	}
+
+	// decode thread
+	void startLoadingNext() {
+		loader.player = &players[1 - current];
+		loader.path = playlist[(clipIndex + 1) % playlist.size()];
+		loader.loaded = false;
+		loader.startThread();
+		nextLoading = true;
+	}
+
+	// decode thread
+	void switchToNext() {
+		if (!nextLoading) {
+			startLoadingNext();
+		}
+		loader.waitForThread(false);
+		players[current].close();
+		current = 1 - current;
+		clipIndex = (clipIndex + 1) % playlist.size();
+		if (clipIndex == 0) {
+			decodeLoops++;
+		}
+		clipFrame = 0;
+		nextLoading = false;
+		if (!loader.loaded) {
+			// don't spin on a broken playlist
+			ofSleepMillis(100);
+		}
+	}
+
+	void threadedFunction() {
+		Loader::open(players[current], playlist[clipIndex]);
+
+		while (isThreadRunning()) {
+			ofVideoPlayer& player = players[current];
+			if (!player.isLoaded()) {
+				switchToNext();
+				continue;
+			}
+
+			double remaining = (player.getTotalNumFrames() - clipFrame) * getFrameDuration(player);
+			if (!nextLoading && remaining <= PREOPEN_TIME) {
+				startLoadingNext();
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(ringMutex);
+				if (!ringSpace.wait_for(lock, std::chrono::milliseconds(10), [this] { return ringCount < RING_SIZE; }))
+					continue;
+			}
+
+			if (!decodeFrame(player)) {
+				switchToNext();
+			}
+		}
+		loader.waitForThread(false);
+	}
+
+public:
+	ofxVideoSource() : current(0), clipIndex(0), clipFrame(0), decodeLoops(0), loops(0), presentedClip(0), presentedClipFrame(-1), presentedClipFrames(0),
+		nextLoading(false), ringStart(0), ringCount(0),
+		decodedFrames(0), presentTime(0), fixedStep(0), virtualTime(0), opened(false) {
+		playlist.push_back("video.mov");
+	}
+	~ofxVideoSource() { close(); }
+
+	string getName() const { return "video"; }
+
+	// A video file or a folder of them, played in name order. Takes effect on the next open()
+	void setup(const string& path) {
+		playlist.clear();
+		ofDirectory dir(path);
+		if (dir.isDirectory()) {
+			dir.allowExt("mov");
+			dir.allowExt("mp4");
+			dir.allowExt("m4v");
+			dir.allowExt("avi");
+			dir.allowExt("mkv");
+			dir.listDir();
+			dir.sort();
+			for (size_t i = 0; i < dir.size(); i++) {
+				playlist.push_back(dir.getPath(i));
+			}
+		}
+		else {
+			playlist.push_back(path);
+		}
+	}
+
+	const vector<string>& getPlaylist() const { return playlist; }
+
+	// seconds of playback per update(), 0 follows the wall clock. Takes effect on the next open()
+	void setFixedStep(double _step) { fixedStep = _step; }
+	// times playback went through the whole playlist
+	int getLoopCount() const { return loops; }
+	// where the presented frame is in the playlist, the frame is -1 before the first one
+	const string& getClipPath() const { return playlist[presentedClip % playlist.size()]; }
+	int getClipFrame() const { return presentedClipFrame; }
+	int getClipFrameCount() const { return presentedClipFrames; }
+
+	bool open() {
+		if (opened)
+			return true;
+		if (playlist.empty()) {
+			ofLogError("ofxVideoSource") << "empty playlist";
+			return false;
+		}
+		current = 0;
+		clipIndex = 0;
+		clipFrame = 0;
+		decodeLoops = 0;
+		loops = 0;
+		presentedClip = 0;
+		presentedClipFrame = -1;
+		presentedClipFrames = 0;
+		nextLoading = false;
+		ringStart = 0;
+		ringCount = 0;
+		presentTime = 0;
+		virtualTime = 0;
+		opened = true;
+		startThread();
+		return true;
+	}
+
+	void close() {
+		if (!opened)
+			return;
+		stopThread();
+		ringSpace.notify_all();
+		waitForThread(false);
+		players[0].close();
+		players[1].close();
+		opened = false;
+	}
+
+	bool isOpen() const { return opened; }
+
+	// Presents the front frame of the ring once it is due
+	bool update() {
+		bool fixed = fixedStep > 0;
+		double time = fixed ? virtualTime : now();
+		if (fixed) {
+			virtualTime += fixedStep;
+		}
+
+		bool presented = false;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(ringMutex);
+				if (fixed && time >= presentTime) {
+					ringFilled.wait_for(lock, std::chrono::seconds(5), [this] { return ringCount > 0; });
+				}
+				if (ringCount == 0 || time < presentTime)
+					break;
+			}
+
+			// the front slot stays with the render thread until it is popped
+			Slot& slot = ring[ringStart];
+			// more than a frame late (first frame or the source was only kept warm): restart the clock
+			if (!fixed && time - presentTime > slot.duration) {
+				presentTime = time;
+			}
+			// steps longer than a frame skip the frames in between
+			if (!fixed || time < presentTime + slot.duration) {
+				ofPixels& pixels = slot.frame.pixels;
+				if (!texture.isAllocated() || texture.getWidth() != pixels.getWidth() || texture.getHeight() != pixels.getHeight()) {
+					texture.allocate(pixels);
+				}
+				uploader.upload(texture, pixels);
+				frameSequence = slot.frame.sequence;
+				frameTime = presentTime;
+				loops = slot.loop;
+				presentedClip = slot.clip;
+				presentedClipFrame = slot.clipFrame;
+				presentedClipFrames = slot.clipFrames;
+				presented = true;
+			}
+			presentTime += slot.duration;
+
+			{
+				std::lock_guard<std::mutex> lock(ringMutex);
+				ringStart = (ringStart + 1) % RING_SIZE;
+				ringCount--;
+			}
+			ringSpace.notify_one();
+			if (!fixed)
+				break;
+		}
+		return presented;
+	}
+
+	ofTexture& getTexture() { return texture; }
+};
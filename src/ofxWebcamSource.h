@@ -0,0 +1,55 @@
+//
+//  ofxWebcamSource.h
+//  visionquest
+//
+//  The default video grabber as an ofxFrameSource. The grabber is polled on the capture thread without a
+//  texture of its own, only new frames are handed over and uploaded.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxFrameSource.h"
+
+class ofxWebcamSource : public ofxThreadedFrameSource {
+	ofVideoGrabber grabber;
+	int width;
+	int height;
+
+public:
+	ofxWebcamSource() : width(640), height(480) {}
+	~ofxWebcamSource() { close(); }
+
+	string getName() const { return "webcam"; }
+
+	// takes effect on the next open()
+	void setup(int _width, int _height) {
+		width = _width;
+		height = _height;
+	}
+
+protected:
+	bool openDevice() {
+		grabber.setUseTexture(false);
+		if (!grabber.setup(width, height, false)) {
+			ofLogError("ofxWebcamSource") << "failed to open the webcam";
+			return false;
+		}
+		return true;
+	}
+
+	void closeDevice() {
+		grabber.close();
+	}
+
+	bool captureFrame(ofxSourceFrame& frame) {
+		grabber.update();
+		if (!grabber.isFrameNew()) {
+			ofSleepMillis(1);
+			return false;
+		}
+		frame.pixels = grabber.getPixels();
+		frame.captureTime = now();
+		return true;
+	}
+};
@@ -4,6 +4,13 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <cmath>
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+	#define PS3EYE_USE_SSE2
+	#include <emmintrin.h>
+#endif
 
 #if defined WIN32 || defined _WIN32 || defined WINCE
 	#include <windows.h>
@@ -287,6 +294,28 @@ static const uint8_t sensor_start_vga[][2] = {
 	{0x2c, 0xf0},
 	{0x65, 0x20},
 };
+/* raw mode: frame size = 0x012C00 * 4 = 307200 bytes (640 * 480 @ 8bpp) */
+static const uint8_t bridge_start_vga_raw[][2] = {
+	{0x1c, 0x00},
+	{0x1d, 0x40},
+	{0x1d, 0x02},
+	{0x1d, 0x00},
+	{0x1d, 0x01},
+	{0x1d, 0x2c},
+	{0x1d, 0x00},
+	{0xc0, 0x50},
+	{0xc1, 0x3c},
+};
+static const uint8_t sensor_start_vga_raw[][2] = {
+	{0x12, 0x01},	// COM7 - VGA, processed Bayer RAW
+	{0x17, 0x26},
+	{0x18, 0xa0},
+	{0x19, 0x07},
+	{0x1a, 0xf0},
+	{0x29, 0xa0},
+	{0x2c, 0xf0},
+	{0x65, 0x20},
+};
 static const uint8_t bridge_start_qvga[][2] = {
 	{0x1c, 0x00},
 	{0x1d, 0x40},
@@ -308,6 +337,28 @@ static const uint8_t sensor_start_qvga[][2] = {
 	{0x2c, 0x78},
 	{0x65, 0x2f},
 };
+/* raw mode: frame size = 0x004B00 * 4 = 76800 bytes (320 * 240 @ 8bpp) */
+static const uint8_t bridge_start_qvga_raw[][2] = {
+	{0x1c, 0x00},
+	{0x1d, 0x40},
+	{0x1d, 0x02},
+	{0x1d, 0x00},
+	{0x1d, 0x00},
+	{0x1d, 0x4b},
+	{0x1d, 0x00},
+	{0xc0, 0x28},
+	{0xc1, 0x1e},
+};
+static const uint8_t sensor_start_qvga_raw[][2] = {
+	{0x12, 0x41},	// COM7 - QVGA, processed Bayer RAW
+	{0x17, 0x3f},
+	{0x18, 0x50},
+	{0x19, 0x03},
+	{0x1a, 0x78},
+	{0x29, 0x50},
+	{0x2c, 0x78},
+	{0x65, 0x2f},
+};
 
 /* Values for bmHeaderInfo (Video and Still Image Payload Headers, 2.4.3.3) */
 #define UVC_STREAM_EOH	(1 << 7)
@@ -505,6 +556,91 @@ int USBMgr::listDevices( std::vector<PS3EYECam::PS3EYERef>& list )
 
 static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr);
 
+// Luma statistics for the software auto exposure.
+// Only every LUMA_STATS_ROW_STEP'th row is read, and only every 4th sample of those goes into the histogram.
+// step is the distance in bytes between two luma samples: 2 for YUYV, 1 for raw bayer.
+#define LUMA_STATS_ROW_STEP		4
+#define LUMA_STATS_HIGHLIGHT	235
+#define LUMA_STATS_SHADOW		16
+
+static inline uint32_t popcount16(uint32_t v)
+{
+	v = v - ((v >> 1) & 0x5555);
+	v = (v & 0x3333) + ((v >> 2) & 0x3333);
+	v = (v + (v >> 4)) & 0x0f0f;
+	return (v + (v >> 8)) & 0x1f;
+}
+
+static void compute_luma_stats(const uint8_t* frame, uint32_t width, uint32_t height, uint32_t stride, uint32_t step, LumaStats& stats)
+{
+	uint64_t sum = 0;
+	uint32_t samples = 0;
+	uint32_t highlights = 0;
+	uint32_t shadows = 0;
+	uint32_t histogram[LumaStats::HISTOGRAM_BINS] = { 0 };
+
+	for (uint32_t y = 0; y < height; y += LUMA_STATS_ROW_STEP)
+	{
+		const uint8_t* row = frame + y * stride;
+		uint32_t x = 0;
+
+#ifdef PS3EYE_USE_SSE2
+		// 16 luma samples per iteration
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i luma_mask = _mm_set1_epi16(0x00ff);
+		const __m128i highlight = _mm_set1_epi8((char)LUMA_STATS_HIGHLIGHT);
+		const __m128i shadow = _mm_set1_epi8((char)LUMA_STATS_SHADOW);
+		__m128i row_sum = _mm_setzero_si128();
+		uint8_t luma[16];
+
+		for (; x + 16 <= width; x += 16)
+		{
+			__m128i packed;
+			if (step == 2) {
+				// YUYV: keep the Y bytes of 2 x 8 pixels and pack them to 16 bytes
+				__m128i lo = _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + x * 2)), luma_mask);
+				__m128i hi = _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + x * 2 + 16)), luma_mask);
+				packed = _mm_packus_epi16(lo, hi);
+			} else {
+				packed = _mm_loadu_si128((const __m128i*)(row + x));
+			}
+
+			row_sum = _mm_add_epi64(row_sum, _mm_sad_epu8(packed, zero));
+			// a >= b  <=>  max(a, b) == a ; a <= b  <=>  min(a, b) == a
+			highlights += popcount16(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(packed, highlight), packed)));
+			shadows += popcount16(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(packed, shadow), packed)));
+
+			_mm_storeu_si128((__m128i*)luma, packed);
+			histogram[luma[0] >> 4]++;
+			histogram[luma[4] >> 4]++;
+			histogram[luma[8] >> 4]++;
+			histogram[luma[12] >> 4]++;
+		}
+		uint64_t sums[2];
+		_mm_storeu_si128((__m128i*)sums, row_sum);
+		sum += sums[0] + sums[1];
+		samples += x;
+#endif
+
+		for (; x < width; x++)
+		{
+			uint8_t value = row[x * step];
+			sum += value;
+			samples++;
+			if (value >= LUMA_STATS_HIGHLIGHT) highlights++;
+			if (value <= LUMA_STATS_SHADOW) shadows++;
+			if ((x & 3) == 0) histogram[value >> 4]++;
+		}
+	}
+
+	memcpy(stats.histogram, histogram, sizeof(histogram));
+	stats.samples = samples;
+	stats.mean = samples ? (uint8_t)(sum / samples) : 0;
+	stats.highlights = highlights;
+	stats.shadows = shadows;
+	stats.frame++;
+}
+
 class FrameQueue
 {
 public:
@@ -516,6 +652,7 @@ public:
 		tail				(0),
 		available			(0)
 	{
+		memset(frame_time, 0, sizeof(frame_time));
 	}
 
 	~FrameQueue()
@@ -528,12 +665,15 @@ public:
 		return frame_buffer;
 	}
 
-	uint8_t* Enqueue()
+	uint8_t* Enqueue(double timestamp)
 	{
 		uint8_t* new_frame = NULL;
 
 		std::lock_guard<std::mutex> lock(mutex);
 
+		// the frame at head was just completed
+		frame_time[head] = timestamp;
+
 		// Unlike traditional producer/consumer, we don't block the producer if the buffer is full (ie. the consumer is not reading data fast enough).
 		// Instead, if the buffer is full, we simply return the current frame pointer, causing the producer to overwrite the previous frame.
 		// This allows performance to degrade gracefully: if the consumer is not fast enough (< Camera FPS), it will miss frames, but if it is fast enough (>= Camera FPS), it will see everything.
@@ -559,7 +699,7 @@ public:
 		return new_frame;
 	}
 
-	uint8_t* Dequeue()
+	uint8_t* Dequeue(double* timestamp)
 	{
 		uint8_t* new_frame = (uint8_t*)malloc(frame_size);
 		
@@ -571,6 +711,8 @@ public:
 		// Copy from internal buffer
 		uint8_t* source = frame_buffer + frame_size * tail;
 		memcpy(new_frame, source, frame_size);
+		if (timestamp)
+			*timestamp = frame_time[tail];
 
 		// Update tail and available count
 		tail = (tail + 1) % num_frames;
@@ -587,6 +729,7 @@ private:
 	uint32_t				head;
 	uint32_t				tail;
 	uint32_t				available;
+	double					frame_time[2];	// completion time of each frame, see PS3EYECam::getTime()
 
 	std::mutex				mutex;
 	std::condition_variable	empty_condition;
@@ -606,8 +749,14 @@ public:
 		cur_frame_start			(NULL),
 		cur_frame_data_len		(0),
 		frame_size				(0),
-		frame_queue				(NULL)
+		frame_queue				(NULL),
+		frame_width				(0),
+		frame_height			(0),
+		frame_stride			(0),
+		sample_step				(2),
+		stats_enabled			(false)
 	{
+		memset(&stats, 0, sizeof(stats));
 	}
 
 	~URBDesc()
@@ -616,10 +765,14 @@ public:
 		close_transfers();
 	}
 
-	bool start_transfers(libusb_device_handle *handle, uint32_t curr_frame_size)
+	bool start_transfers(libusb_device_handle *handle, uint32_t width, uint32_t height, uint32_t stride, uint32_t step)
 	{
 		// Initialize the frame queue
-        frame_size = curr_frame_size;
+		frame_width = width;
+		frame_height = height;
+		frame_stride = stride;
+		sample_step = step;
+        frame_size = stride * height;
 		frame_queue = new FrameQueue(frame_size);
 
 		// Initialize the current frame pointer to the start of the buffer; it will be updated as frames are completed and pushed onto the frame queue
@@ -725,7 +878,18 @@ public:
 
 	    if (packet_type == LAST_PACKET) {        
 			cur_frame_data_len = 0;
-			cur_frame_start = frame_queue->Enqueue();
+			if (stats_enabled) {
+				// the frame is complete and still hot in the cache - cheapest moment to look at it
+				LumaStats frame_stats;
+				{
+					std::lock_guard<std::mutex> lock(stats_mutex);
+					frame_stats = stats;
+				}
+				compute_luma_stats(cur_frame_start, frame_width, frame_height, frame_stride, sample_step, frame_stats);
+				std::lock_guard<std::mutex> lock(stats_mutex);
+				stats = frame_stats;
+			}
+			cur_frame_start = frame_queue->Enqueue(PS3EYECam::getTime());
 	        //debug("frame completed %d\n", frame_complete_ind);
 	    }
 	}
@@ -817,6 +981,15 @@ public:
 	uint32_t				cur_frame_data_len;
 	uint32_t				frame_size;
 	FrameQueue*				frame_queue;
+
+	uint32_t				frame_width;
+	uint32_t				frame_height;
+	uint32_t				frame_stride;
+	uint32_t				sample_step;
+
+	std::atomic_bool		stats_enabled;
+	std::mutex				stats_mutex;
+	LumaStats				stats;
 };
 
 static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr)
@@ -882,11 +1055,18 @@ PS3EYECam::PS3EYECam(libusb_device *device)
 	greenblc = 128;
     flip_h = false;
     flip_v = false;
+	software_aec = false;
+	aec_target = 110;
+	aec_speed = 0.5f;
+	aec_interval_ms = 100;
+	aec_last_frame = 0;
+	aec_last_update = 0;
 
 	usb_buf = NULL;
 	handle_ = NULL;
 
 	is_streaming = false;
+	output_format = OUTPUT_YUYV;
 
 	device_ = device;
 	mgrPtr = USBMgr::instance();
@@ -911,7 +1091,7 @@ void PS3EYECam::release()
 //#endif
 }
 
-bool PS3EYECam::init(uint32_t width, uint32_t height, uint8_t desiredFrameRate)
+bool PS3EYECam::init(uint32_t width, uint32_t height, uint8_t desiredFrameRate, EOutputFormat outputFormat)
 {
 	uint16_t sensor_id;
 
@@ -951,8 +1131,10 @@ bool PS3EYECam::init(uint32_t width, uint32_t height, uint8_t desiredFrameRate)
 		frame_width = 320;
 		frame_height = 240;
 	}
+	output_format = outputFormat;
 	frame_rate = ov534_set_frame_rate(desiredFrameRate, true);
-    frame_stride = frame_width * 2;
+	// raw Bayer is a single byte per pixel, YUYV two
+    frame_stride = frame_width * (output_format == OUTPUT_BAYER ? 1 : 2);
 	//
 
 	/* reset bridge */
@@ -998,11 +1180,21 @@ void PS3EYECam::start()
     if(is_streaming) return;
     
 	if (frame_width == 320) {	/* 320x240 */
-		reg_w_array(bridge_start_qvga, ARRAY_SIZE(bridge_start_qvga));
-		sccb_w_array(sensor_start_qvga, ARRAY_SIZE(sensor_start_qvga));
+		if (output_format == OUTPUT_BAYER) {
+			reg_w_array(bridge_start_qvga_raw, ARRAY_SIZE(bridge_start_qvga_raw));
+			sccb_w_array(sensor_start_qvga_raw, ARRAY_SIZE(sensor_start_qvga_raw));
+		} else {
+			reg_w_array(bridge_start_qvga, ARRAY_SIZE(bridge_start_qvga));
+			sccb_w_array(sensor_start_qvga, ARRAY_SIZE(sensor_start_qvga));
+		}
 	} else {		/* 640x480 */
-		reg_w_array(bridge_start_vga, ARRAY_SIZE(bridge_start_vga));
-		sccb_w_array(sensor_start_vga, ARRAY_SIZE(sensor_start_vga));
+		if (output_format == OUTPUT_BAYER) {
+			reg_w_array(bridge_start_vga_raw, ARRAY_SIZE(bridge_start_vga_raw));
+			sccb_w_array(sensor_start_vga_raw, ARRAY_SIZE(sensor_start_vga_raw));
+		} else {
+			reg_w_array(bridge_start_vga, ARRAY_SIZE(bridge_start_vga));
+			sccb_w_array(sensor_start_vga, ARRAY_SIZE(sensor_start_vga));
+		}
 	}
 
 	ov534_set_frame_rate(frame_rate);
@@ -1024,7 +1216,7 @@ void PS3EYECam::start()
 	ov534_reg_write(0xe0, 0x00); // start stream
 
 	// init and start urb
-	urb->start_transfers(handle_, frame_stride*frame_height);
+	urb->start_transfers(handle_, frame_width, frame_height, frame_stride, output_format == OUTPUT_BAYER ? 1 : 2);
     is_streaming = true;
 }
 
@@ -1043,9 +1235,83 @@ void PS3EYECam::stop()
     is_streaming = false;
 }
 
-uint8_t* PS3EYECam::getFrame()
+double PS3EYECam::getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint8_t* PS3EYECam::getFrame(double* timestamp)
+{
+	uint8_t* frame = urb->frame_queue->Dequeue(timestamp);
+	if (software_aec) {
+		update_auto_exposure();
+	}
+	return frame;
+}
+
+void PS3EYECam::enable_luma_stats(bool enable)
+{
+	urb->stats_enabled = enable;
+}
+
+bool PS3EYECam::getLumaStats(LumaStats& stats) const
 {
-	return urb->frame_queue->Dequeue();
+	std::lock_guard<std::mutex> lock(urb->stats_mutex);
+	stats = urb->stats;
+	return stats.frame != 0;
+}
+
+/* total sensor gain of a gain register value, see setGain() */
+static float gain_multiplier(uint8_t gain)
+{
+	return (1.0f + (gain & 0x0f) / 16.0f) * (float)(1 << ((gain >> 4) & 0x03));
+}
+
+void PS3EYECam::update_auto_exposure()
+{
+	LumaStats stats;
+	if (!getLumaStats(stats) || stats.frame == aec_last_frame || stats.samples == 0)
+		return;
+
+	// rate limit: every register write is a handful of blocking control transfers
+	double now = getTime();
+	if ((now - aec_last_update) * 1000.0 < aec_interval_ms)
+		return;
+	aec_last_frame = stats.frame;
+
+	// clipped highlights hide how much too bright we are, count them a bit heavier than the mean says
+	float mean = (float)stats.mean + 64.0f * stats.highlights / stats.samples;
+	float error = (float)aec_target - mean;
+	if (fabsf(error) < 6.0f)
+		return;
+
+	// multiplicative controller on exposure * gain, limited to one stop per step
+	float ratio = powf(aec_target / (mean < 1.0f ? 1.0f : mean), aec_speed);
+	ratio = ratio < 0.5f ? 0.5f : (ratio > 2.0f ? 2.0f : ratio);
+	uint8_t current_exposure = exposure;
+	float total = (current_exposure < 1 ? 1 : current_exposure) * gain_multiplier(gain) * ratio;
+
+	// prefer exposure (no extra noise), only add gain once exposure is maxed out
+	uint8_t new_exposure = 255;
+	uint8_t new_gain = 0;
+	if (total <= 255.0f) {
+		new_exposure = (uint8_t)(total < 1.0f ? 1.0f : total);
+	} else {
+		float needed = total / 255.0f;
+		new_gain = 63;
+		for (uint8_t g = 0; g < 64; g++) {
+			if (gain_multiplier(g) >= needed) {
+				new_gain = g;
+				break;
+			}
+		}
+	}
+
+	if (new_exposure != exposure)
+		write_exposure(new_exposure);
+	if (new_gain != gain)
+		write_gain(new_gain);
+	aec_last_update = now;
 }
 
 bool PS3EYECam::open_usb()
@@ -1124,6 +1390,14 @@ uint8_t PS3EYECam::ov534_set_frame_rate(uint8_t frame_rate, bool dry_run)
              {30, 0x04, 0x81, 0x02},
              {15, 0x03, 0x41, 0x04},
      };
+     static const struct rate_s rate_0_raw[] = { /* 640x480 raw - half the bandwidth of YUYV */
+             {75, 0x01, 0x81, 0x02},
+             {60, 0x01, 0xc1, 0x04},
+             {50, 0x01, 0x41, 0x02},
+             {40, 0x02, 0xc1, 0x04},
+             {30, 0x04, 0x81, 0x02},
+             {15, 0x03, 0x41, 0x04},
+     };
      static const struct rate_s rate_1[] = { /* 320x240 */
              {205, 0x01, 0xc1, 0x02}, /* 205 FPS: video is partly corrupt */
              {187, 0x01, 0x81, 0x02}, /* 187 FPS or below: video is valid */
@@ -1138,7 +1412,10 @@ uint8_t PS3EYECam::ov534_set_frame_rate(uint8_t frame_rate, bool dry_run)
              {30, 0x04, 0x41, 0x04},
      };
 
-     if (frame_width == 640) {
+     if (frame_width == 640 && output_format == OUTPUT_BAYER) {
+             r = rate_0_raw;
+             i = ARRAY_SIZE(rate_0_raw);
+     } else if (frame_width == 640) {
              r = rate_0;
              i = ARRAY_SIZE(rate_0);
      } else {
@@ -1163,6 +1440,7 @@ uint8_t PS3EYECam::ov534_set_frame_rate(uint8_t frame_rate, bool dry_run)
 
 void PS3EYECam::ov534_reg_write(uint16_t reg, uint8_t val)
 {
+	std::lock_guard<std::recursive_mutex> lock(usb_buf_mutex);
 	int ret;
 
 	//debug("reg=0x%04x, val=0%02x", reg, val);
@@ -1180,6 +1458,7 @@ void PS3EYECam::ov534_reg_write(uint16_t reg, uint8_t val)
 
 uint8_t PS3EYECam::ov534_reg_read(uint16_t reg)
 {
+	std::lock_guard<std::recursive_mutex> lock(usb_buf_mutex);
 	int ret;
 
 	ret = libusb_control_transfer(handle_,
@@ -1220,6 +1499,7 @@ int PS3EYECam::sccb_check_status()
 
 void PS3EYECam::sccb_reg_write(uint8_t reg, uint8_t val)
 {
+	std::lock_guard<std::recursive_mutex> lock(usb_buf_mutex);
 	//debug("reg: 0x%02x, val: 0x%02x", reg, val);
 	ov534_reg_write(OV534_REG_SUBADDR, reg);
 	ov534_reg_write(OV534_REG_WRITE, val);
@@ -1233,6 +1513,7 @@ void PS3EYECam::sccb_reg_write(uint8_t reg, uint8_t val)
 
 uint8_t PS3EYECam::sccb_reg_read(uint16_t reg)
 {
+	std::lock_guard<std::recursive_mutex> lock(usb_buf_mutex);
 	ov534_reg_write(OV534_REG_SUBADDR, (uint8_t)reg);
 	ov534_reg_write(OV534_REG_OPERATION, OV534_OP_WRITE_2);
 	if (!sccb_check_status()) {
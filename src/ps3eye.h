@@ -7,6 +7,8 @@
 #include <vector>
 
 #include <memory>
+#include <mutex>
+#include <atomic>
 
 
 #include "libusb/libusb.h"
@@ -26,6 +28,18 @@
 
 namespace ps3eye {
 
+// Luma statistics of the last completed frame, gathered on the usb thread
+struct LumaStats {
+	static const int HISTOGRAM_BINS = 16;
+
+	uint32_t histogram[HISTOGRAM_BINS];	// coarse histogram of the sampled luma values
+	uint32_t samples;					// number of samples behind mean/highlights/shadows
+	uint8_t mean;						// mean luma 0 <-> 255
+	uint32_t highlights;				// samples at or above the clipping threshold
+	uint32_t shadows;					// samples at or below the black threshold
+	uint32_t frame;						// increments for every frame the stats were taken from
+};
+
 class PS3EYECam
 {
 public:
@@ -34,10 +48,16 @@ public:
 	static const uint16_t VENDOR_ID;
 	static const uint16_t PRODUCT_ID;
 
+	// Format of the frames delivered over USB
+	enum EOutputFormat {
+		OUTPUT_YUYV,	// YUV 4:2:2 from the sensor DSP, 2 bytes per pixel
+		OUTPUT_BAYER	// processed Bayer RAW (BGGR), 1 byte per pixel - half the USB bandwidth
+	};
+
 	PS3EYECam(libusb_device *device);
 	~PS3EYECam();
 
-	bool init(uint32_t width = 0, uint32_t height = 0, uint8_t desiredFrameRate = 30);
+	bool init(uint32_t width = 0, uint32_t height = 0, uint8_t desiredFrameRate = 30, EOutputFormat outputFormat = OUTPUT_YUYV);
 	void start();
 	void stop();
 
@@ -47,14 +67,17 @@ public:
 	void setAutogain(bool val) {
 	    autogain = val;
 	    if (val) {
+			// the sensor loop and the software loop would fight over the same registers
+			software_aec = false;
+			enable_luma_stats(false);
 			sccb_reg_write(0x13, 0xf7); //AGC,AEC,AWB ON
 			sccb_reg_write(0x64, sccb_reg_read(0x64)|0x03);
 	    } else {
 			sccb_reg_write(0x13, 0xf0); //AGC,AEC,AWB OFF
 			sccb_reg_write(0x64, sccb_reg_read(0x64)&0xFC);
 
-			setGain(gain);
-			setExposure(exposure);
+			write_gain(gain);
+			write_exposure(exposure);
 	    }
 	}
 	bool getAutoWhiteBalance() const { return awb; }
@@ -67,32 +90,17 @@ public:
 	    }
 	}
 	uint8_t getGain() const { return gain; }
+	// ignored while software auto exposure runs, it owns gain and exposure then
 	void setGain(uint8_t val) {
-	    gain = val;
-	    switch(val & 0x30){
-		case 0x00:
-		    val &=0x0F;
-		    break;
-		case 0x10:
-		    val &=0x0F;
-		    val |=0x30;
-		    break;
-		case 0x20:
-		    val &=0x0F;
-		    val |=0x70;
-		    break;
-		case 0x30:
-		    val &=0x0F;
-		    val |=0xF0;
-		    break;
-	    }
-	    sccb_reg_write(0x00, val);
+		if (software_aec)
+			return;
+		write_gain(val);
 	}
 	uint8_t getExposure() const { return exposure; }
 	void setExposure(uint8_t val) {
-	    exposure = val;
-	    sccb_reg_write(0x08, val>>7);
-    	sccb_reg_write(0x10, val<<1);
+		if (software_aec)
+			return;
+		write_exposure(val);
 	}
 	uint8_t getSharpness() const { return sharpness; }
 	void setSharpness(uint8_t val) {
@@ -143,17 +151,41 @@ public:
 	}
     
 
+	// Software auto exposure: an alternative to the sensor AGC/AEC that settles faster and doesn't hunt
+	// under strobing light. Statistics are taken on the usb thread, the controller runs in getFrame() so
+	// the control transfers are issued from the consumer thread and at most once per interval.
+	bool getSoftwareAutoExposure() const { return software_aec; }
+	void setSoftwareAutoExposure(bool val) {
+		if (val && autogain) {
+			setAutogain(false);
+		}
+		software_aec = val;
+		enable_luma_stats(val);
+	}
+	uint8_t getAutoExposureTarget() const { return aec_target; }
+	void setAutoExposureTarget(uint8_t val) { aec_target = val; }
+	float getAutoExposureSpeed() const { return aec_speed; }
+	void setAutoExposureSpeed(float val) { aec_speed = val < 0.f ? 0.f : (val > 1.f ? 1.f : val); }
+	uint32_t getAutoExposureInterval() const { return aec_interval_ms; }
+	void setAutoExposureInterval(uint32_t ms) { aec_interval_ms = ms; }
+	// Returns false if no statistics were gathered yet
+	bool getLumaStats(LumaStats& stats) const;
+
     bool isStreaming() const { return is_streaming; }
 	
 	// Get a frame from the camera. Notes:
 	// - If there is no frame available, this function will block until one is
 	// - The returned frame is a malloc'd copy; you must free() it yourself when done with it
-	uint8_t* getFrame();
+	// - timestamp (optional) receives the time the last packet of the frame arrived, in getTime() seconds
+	uint8_t* getFrame(double* timestamp = NULL);
+	// Monotonic clock used for the frame timestamps, in seconds
+	static double getTime();
 
 	uint32_t getWidth() const { return frame_width; }
 	uint32_t getHeight() const { return frame_height; }
 	uint8_t getFrameRate() const { return frame_rate; }
 	uint32_t getRowBytes() const { return frame_stride; }
+	EOutputFormat getOutputFormat() const { return output_format; }
 
 	//
 	static const std::vector<PS3EYERef>& getDevices( bool forceRefresh = false );
@@ -175,10 +207,45 @@ private:
 	void reg_w_array(const uint8_t (*data)[2], int len);
 	void sccb_w_array(const uint8_t (*data)[2], int len);
 
+	// software auto exposure
+	void enable_luma_stats(bool enable);
+	void update_auto_exposure();
+
+	// gain and exposure take several register writes, a write from the other thread mustn't land in between
+	void write_gain(uint8_t val) {
+		std::lock_guard<std::recursive_mutex> lock(usb_buf_mutex);
+	    gain = val;
+	    switch(val & 0x30){
+		case 0x00:
+		    val &=0x0F;
+		    break;
+		case 0x10:
+		    val &=0x0F;
+		    val |=0x30;
+		    break;
+		case 0x20:
+		    val &=0x0F;
+		    val |=0x70;
+		    break;
+		case 0x30:
+		    val &=0x0F;
+		    val |=0xF0;
+		    break;
+	    }
+	    sccb_reg_write(0x00, val);
+	}
+	void write_exposure(uint8_t val) {
+		std::lock_guard<std::recursive_mutex> lock(usb_buf_mutex);
+	    exposure = val;
+	    sccb_reg_write(0x08, val>>7);
+    	sccb_reg_write(0x10, val<<1);
+	}
+
 	// controls
 	bool autogain;
-	uint8_t gain; // 0 <-> 63
-	uint8_t exposure; // 0 <-> 255
+	// written by the software auto exposure on the capture thread, read on the app thread
+	std::atomic<uint8_t> gain; // 0 <-> 63
+	std::atomic<uint8_t> exposure; // 0 <-> 255
 	uint8_t sharpness; // 0 <-> 63
 	uint8_t hue; // 0 <-> 255
 	bool awb;
@@ -189,6 +256,13 @@ private:
 	uint8_t greenblc; // 0 <-> 255
     bool flip_h;
     bool flip_v;
+	// set on the app thread, read on the capture thread
+	std::atomic<bool> software_aec;
+	std::atomic<uint8_t> aec_target; // 0 <-> 255
+	std::atomic<float> aec_speed; // 0 <-> 1
+	uint32_t aec_interval_ms;
+	uint32_t aec_last_frame;
+	double aec_last_update;
 	//
     bool is_streaming;
 
@@ -201,6 +275,7 @@ private:
 	uint32_t frame_height;
 	uint32_t frame_stride;
 	uint8_t frame_rate;
+	EOutputFormat output_format;
 
 	double last_qued_frame_time;
 
@@ -208,6 +283,9 @@ private:
 	libusb_device *device_;
 	libusb_device_handle *handle_;
 	uint8_t *usb_buf;
+	// control transfers come from the capture thread (software AEC) and the app thread (controls),
+	// an sccb access is several transfers that must not interleave
+	std::recursive_mutex usb_buf_mutex;
 
 	std::shared_ptr<class URBDesc> urb;
 